@@ -0,0 +1,154 @@
+/**
+ * @file cgroup.c
+ * @brief Implementation of the cgroup limit lookup.
+ */
+
+#include "cgroup.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Finds where the cgroup2 hierarchy is mounted (from /proc/self/mountinfo).
+ *
+ * @param dir Receives the mount point.
+ * @param root Receives the cgroup mounted there ("/" unless a subtree is bind-mounted).
+ * @param size The size of both buffers.
+ * @return 0 on success, -1 if it is not mounted.
+ */
+static int cgroup_mount(char *dir, char *root, size_t size)
+{
+    FILE *f = fopen("/proc/self/mountinfo", "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    // Fields: id parent major:minor root mountpoint options [optional...] - fstype source ...
+    char line[4096];
+    int found = 0;
+    while (!found && fgets(line, sizeof(line), f) != NULL) {
+        const char *sep = strstr(line, " - ");
+        char mountroot[PATH_MAX];
+        char mountpoint[PATH_MAX];
+        if (sep != NULL && strncmp(sep + 3, "cgroup2 ", 8) == 0 &&
+            sscanf(line, "%*s %*s %*s %4095s %4095s", mountroot, mountpoint) == 2) {
+            snprintf(dir, size, "%s", mountpoint);
+            snprintf(root, size, "%s", mountroot);
+            found = 1;
+        }
+    }
+    fclose(f);
+    return found ? 0 : -1;
+}
+
+/**
+ * @brief Finds the process's cgroup v2 path (the "0::" line of /proc/self/cgroup).
+ * @return 0 on success, -1 if the process is not in a cgroup v2.
+ */
+static int cgroup_path(char *path, size_t size)
+{
+    FILE *f = fopen("/proc/self/cgroup", "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    char line[4096];
+    int found = 0;
+    while (!found && fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(path, size, "%s", line + 3);
+            found = 1;
+        }
+    }
+    fclose(f);
+    return found ? 0 : -1;
+}
+
+/**
+ * @brief Reads the first line of a control file.
+ * @return 0 on success, -1 if it does not exist.
+ */
+static int cgroup_read_file(const char *dir, const char *name, char *buf, size_t size)
+{
+    char file[PATH_MAX];
+    snprintf(file, sizeof(file), "%s/%s", dir, name);
+    FILE *f = fopen(file, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    int ok = fgets(buf, (int)size, f) != NULL;
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Tightens the limits with those of one cgroup directory.
+ */
+static void cgroup_read_dir(const char *dir, struct cgroup_limits *limits)
+{
+    char buf[128];
+
+    // cpu.max: "QUOTA PERIOD" in microseconds, or "max PERIOD".
+    unsigned long long quota, period;
+    if (cgroup_read_file(dir, "cpu.max", buf, sizeof(buf)) == 0 &&
+        sscanf(buf, "%llu %llu", &quota, &period) == 2 && period > 0) {
+        double cpus = (double)quota / (double)period;
+        if (limits->cpus == 0 || cpus < limits->cpus) {
+            limits->cpus = cpus;
+        }
+    }
+
+    // memory.max: bytes, or "max".
+    unsigned long long bytes;
+    if (cgroup_read_file(dir, "memory.max", buf, sizeof(buf)) == 0 &&
+        sscanf(buf, "%llu", &bytes) == 1 && bytes > 0) {
+        if (limits->memory == 0 || bytes < limits->memory) {
+            limits->memory = bytes;
+        }
+    }
+}
+
+void cgroup_read_limits(struct cgroup_limits *limits)
+{
+    char mount[PATH_MAX];
+    char root[PATH_MAX];
+    char path[PATH_MAX];
+
+    limits->cpus = 0;
+    limits->memory = 0;
+    if (cgroup_mount(mount, root, sizeof(mount)) < 0 || cgroup_path(path, sizeof(path)) < 0) {
+        return;
+    }
+
+    // The process's path is relative to the hierarchy's root; the part of it
+    // below the mounted subtree is what lies under the mount point.
+    const char *rel = path;
+    size_t root_len = strlen(root);
+    if (root_len > 1 && strncmp(path, root, root_len) == 0 && (path[root_len] == '/' || path[root_len] == '\0')) {
+        rel = path + root_len;
+    }
+    size_t len = strlen(rel);
+    while (len > 0 && rel[len - 1] == '/') {
+        len--;
+    }
+
+    // The process's own cgroup first, then each parent up to the mount point itself. In a
+    // cgroup namespace (path "/") that is the container's cgroup; the host's root has no limits.
+    char dir[2 * PATH_MAX];
+    for (;;) {
+        snprintf(dir, sizeof(dir), "%s%.*s", mount, (int)len, rel);
+        cgroup_read_dir(dir, limits);
+        if (len == 0) {
+            break;
+        }
+        while (len > 0 && rel[len - 1] != '/') {
+            len--;
+        }
+        if (len > 0) {
+            len--; // Drop the slash as well
+        }
+    }
+}
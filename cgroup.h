@@ -0,0 +1,28 @@
+/**
+ * @file cgroup.h
+ * @brief CPU and memory limits of the cgroup v2 the process runs in.
+ *
+ * In a container, the online CPU count and the machine's memory describe the
+ * host; the limits that actually apply are in the cgroup's cpu.max and
+ * memory.max, and in those of every ancestor up to the cgroup2 mount.
+ */
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include <stdint.h>
+
+struct cgroup_limits {
+    double cpus;                // cpu.max quota / period, in CPUs (0 if unlimited)
+    uint64_t memory;            // memory.max in bytes (0 if unlimited)
+};
+
+/**
+ * @brief Reads the tightest limits of the process's cgroup and its ancestors.
+ *
+ * Without cgroup v2 (or where the files cannot be read) both limits are 0.
+ *
+ * @param limits Receives the limits.
+ */
+void cgroup_read_limits(struct cgroup_limits *limits);
+
+#endif // CGROUP_H
@@ -0,0 +1,780 @@
+/**
+ * @file decompress.c
+ * @brief Implementation of the threaded block decoder (gzip via zlib, zstd via libzstd).
+ */
+
+#include "decompress.h"
+#include "hugepage.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define DECODER_BLOCK_SIZE (1 << 20) // Decompressed bytes per block
+
+#define ZSTD_SEEKABLE_MAGIC 0x8F92EAB1U  // Last four bytes of a seekable-zstd file
+#define ZSTD_SEEKABLE_FOOTER 9          // Frame count, descriptor, magic
+
+struct decoder {
+    enum decoder_format format;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    // Ring of output blocks. Counters only grow; slot = counter % DECODER_BLOCKS.
+    char *blocks[DECODER_BLOCKS];
+    size_t lens[DECODER_BLOCKS];
+    unsigned filled;    // Blocks published by the decoder thread
+    unsigned taken;     // Blocks handed to the reader
+    unsigned released;  // Blocks the reader is finished with
+    int done;           // Decoder reached the end of the input
+    int error;          // Decoder hit corrupt or truncated input
+    int stop;           // Reader asked the decoder to quit
+
+    // Compressed input: `in` first, then read(2) from fd if fd >= 0.
+    int fd;
+    const unsigned char *in;
+    size_t in_len;
+    unsigned char *in_buf; // Owned copy / read buffer when reading from fd
+    const unsigned char *next_in; // Unconsumed compressed bytes
+    size_t avail_in;
+
+    z_stream z;
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *zs;
+    size_t zs_hint;     // Last ZSTD_decompressStream result; 0 at a frame boundary
+#endif
+};
+
+enum decoder_format decoder_detect(const char *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+
+    if (len >= 2 && p[0] == 0x1f && p[1] == 0x8b) {
+        return DECODER_GZIP;
+    }
+    if (len >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd) {
+        return DECODER_ZSTD;
+    }
+    return DECODER_NONE;
+}
+
+int decoder_supported(enum decoder_format format)
+{
+#ifndef HAVE_ZSTD
+    if (format == DECODER_ZSTD) {
+        return 0;
+    }
+#endif
+    return format != DECODER_NONE;
+}
+
+const char *decoder_name(enum decoder_format format)
+{
+    switch (format) {
+        case DECODER_GZIP:
+            return "gzip";
+        case DECODER_ZSTD:
+            return "zstd";
+        default:
+            return "plain";
+    }
+}
+
+/**
+ * @brief Makes more compressed input available in d->next_in.
+ * @return Bytes now available, 0 at end of input, -1 on read error.
+ */
+static ssize_t decoder_refill(struct decoder *d)
+{
+    if (d->avail_in > 0) {
+        return (ssize_t)d->avail_in;
+    }
+    if (d->in_len > 0) {
+        d->next_in = d->in;
+        d->avail_in = d->in_len;
+        d->in_len = 0;
+        return (ssize_t)d->avail_in;
+    }
+    if (d->fd < 0) {
+        return 0;
+    }
+
+    ssize_t n;
+    int oldstate;
+    // The only place the thread may block indefinitely (e.g., an idle pipe),
+    // so it is the only place decoder_stop is allowed to cancel it.
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &oldstate);
+    do {
+        n = read(d->fd, d->in_buf, DECODER_INPUT_SIZE);
+    } while (n < 0 && errno == EINTR);
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &oldstate);
+
+    if (n > 0) {
+        d->next_in = d->in_buf;
+        d->avail_in = (size_t)n;
+    }
+    return n;
+}
+
+/**
+ * @brief Inflates gzip input into one output block.
+ *
+ * Concatenated gzip members (as produced by `cat a.gz b.gz`) are decoded as a
+ * single stream, matching gzip(1).
+ *
+ * @return 0 on success, -1 on error. *finished is set at end of input, and
+ * *produced holds the bytes decoded before an error as well.
+ */
+static int gzip_fill(struct decoder *d, char *out, size_t cap, size_t *produced, int *finished)
+{
+    int rc = 0;
+
+    d->z.next_out = (unsigned char *)out;
+    d->z.avail_out = (uInt)cap;
+
+    while (d->z.avail_out > 0) {
+        ssize_t avail = decoder_refill(d);
+        if (avail <= 0) {
+            rc = -1; // Read error, or input ended inside a gzip member
+            break;
+        }
+
+        // zlib counts input in uInt, so very large mappings are fed in slices.
+        uInt slice = d->avail_in > UINT32_MAX ? UINT32_MAX : (uInt)d->avail_in;
+        d->z.next_in = (unsigned char *)d->next_in;
+        d->z.avail_in = slice;
+        int ret = inflate(&d->z, Z_NO_FLUSH);
+        d->next_in += slice - d->z.avail_in;
+        d->avail_in -= slice - d->z.avail_in;
+
+        if (ret == Z_STREAM_END) {
+            // Another member may follow; anything that is not gzip is ignored.
+            avail = decoder_refill(d);
+            if (avail < 0) {
+                rc = -1;
+                break;
+            }
+            if (avail == 0 || d->next_in[0] != 0x1f) {
+                *finished = 1;
+                break;
+            }
+            inflateReset(&d->z);
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            rc = -1;
+            break;
+        }
+    }
+
+    *produced = cap - d->z.avail_out;
+    return rc;
+}
+
+#ifdef HAVE_ZSTD
+/**
+ * @brief Decodes zstd input into one output block.
+ *
+ * Multiple frames (and skippable frames) are decoded back to back.
+ *
+ * @return 0 on success, -1 on error, with the same conventions as gzip_fill.
+ */
+static int zstd_fill(struct decoder *d, char *out, size_t cap, size_t *produced, int *finished)
+{
+    ZSTD_outBuffer o = { out, cap, 0 };
+    int rc = 0;
+
+    while (o.pos < o.size) {
+        ssize_t avail = decoder_refill(d);
+        if (avail < 0) {
+            rc = -1;
+            break;
+        }
+        if (avail == 0 && d->zs_hint == 0) {
+            *finished = 1; // Input ended on a frame boundary with everything flushed
+            break;
+        }
+
+        ZSTD_inBuffer in = { d->next_in, d->avail_in, 0 };
+        size_t before = o.pos;
+        size_t ret = ZSTD_decompressStream(d->zs, &o, &in);
+        d->next_in += in.pos;
+        d->avail_in -= in.pos;
+        if (ZSTD_isError(ret)) {
+            rc = -1;
+            break;
+        }
+        d->zs_hint = ret;
+
+        if (avail == 0 && o.pos == before && d->zs_hint != 0) {
+            rc = -1; // Input ended inside a frame
+            break;
+        }
+    }
+
+    *produced = o.pos;
+    return rc;
+}
+#endif
+
+/**
+ * @brief Decoder thread: fills free ring slots until the input is exhausted.
+ */
+static void *decoder_main(void *arg)
+{
+    struct decoder *d = arg;
+    int finished = 0;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    while (!finished) {
+        pthread_mutex_lock(&d->lock);
+        while (d->filled - d->released >= DECODER_BLOCKS && !d->stop) {
+            pthread_cond_wait(&d->cond, &d->lock);
+        }
+        int stop = d->stop;
+        unsigned slot = d->filled % DECODER_BLOCKS;
+        pthread_mutex_unlock(&d->lock);
+        if (stop) {
+            break;
+        }
+
+        size_t produced = 0;
+        int rc;
+#ifdef HAVE_ZSTD
+        if (d->format == DECODER_ZSTD) {
+            rc = zstd_fill(d, d->blocks[slot], DECODER_BLOCK_SIZE, &produced, &finished);
+        } else
+#endif
+        rc = gzip_fill(d, d->blocks[slot], DECODER_BLOCK_SIZE, &produced, &finished);
+
+        pthread_mutex_lock(&d->lock);
+        if (produced > 0) {
+            d->lens[slot] = produced; // Publish what decoded cleanly, even before an error
+            d->filled++;
+        }
+        if (rc < 0) {
+            d->error = 1;
+            finished = 1;
+        }
+        if (finished) {
+            d->done = 1;
+        }
+        pthread_cond_broadcast(&d->cond);
+        pthread_mutex_unlock(&d->lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Sets up the format-specific decompression state.
+ */
+static int decoder_init_stream(struct decoder *d)
+{
+#ifdef HAVE_ZSTD
+    if (d->format == DECODER_ZSTD) {
+        d->zs = ZSTD_createDStream();
+        return d->zs != NULL ? 0 : -1;
+    }
+#endif
+    return inflateInit2(&d->z, 16 + MAX_WBITS) == Z_OK ? 0 : -1;
+}
+
+/**
+ * @brief Releases the format-specific decompression state.
+ */
+static void decoder_end_stream(struct decoder *d)
+{
+#ifdef HAVE_ZSTD
+    if (d->format == DECODER_ZSTD) {
+        ZSTD_freeDStream(d->zs);
+        return;
+    }
+#endif
+    inflateEnd(&d->z);
+}
+
+struct decoder *decoder_start(enum decoder_format format, int fd, const char *data, size_t len)
+{
+    struct decoder *d = calloc(1, sizeof(*d));
+    if (d == NULL) {
+        return NULL;
+    }
+    d->format = format;
+    d->fd = fd;
+
+    // One allocation for the whole ring, so it fills whole huge pages.
+    char *ring = hugepage_alloc((size_t)DECODER_BLOCKS * DECODER_BLOCK_SIZE);
+    if (ring == NULL) {
+        free(d);
+        return NULL;
+    }
+    for (int i = 0; i < DECODER_BLOCKS; i++) {
+        d->blocks[i] = ring + (size_t)i * DECODER_BLOCK_SIZE;
+    }
+
+    if (fd >= 0) {
+        // The caller's buffer is only borrowed, so keep a private copy of it.
+        d->in_buf = malloc(len > DECODER_INPUT_SIZE ? len : DECODER_INPUT_SIZE);
+        if (d->in_buf == NULL) {
+            goto fail;
+        }
+        memcpy(d->in_buf, data, len);
+        d->in = d->in_buf;
+    } else {
+        d->in = (const unsigned char *)data;
+    }
+    d->in_len = len;
+
+    if (decoder_init_stream(d) < 0) {
+        goto fail;
+    }
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->cond, NULL);
+
+    if (pthread_create(&d->thread, NULL, decoder_main, d) != 0) {
+        decoder_end_stream(d);
+        pthread_mutex_destroy(&d->lock);
+        pthread_cond_destroy(&d->cond);
+        goto fail;
+    }
+    return d;
+
+fail:
+    hugepage_free(d->blocks[0], (size_t)DECODER_BLOCKS * DECODER_BLOCK_SIZE);
+    free(d->in_buf);
+    free(d);
+    return NULL;
+}
+
+int decoder_next_block(struct decoder *d, const char **data, size_t *len)
+{
+    pthread_mutex_lock(&d->lock);
+
+    // The block handed out last time is free for reuse now.
+    d->released = d->taken;
+    pthread_cond_broadcast(&d->cond);
+
+    while (d->taken == d->filled && !d->done) {
+        pthread_cond_wait(&d->cond, &d->lock);
+    }
+
+    int rc;
+    if (d->taken != d->filled) {
+        unsigned slot = d->taken % DECODER_BLOCKS;
+        *data = d->blocks[slot];
+        *len = d->lens[slot];
+        d->taken++;
+        rc = 1;
+    } else {
+        rc = d->error ? -1 : 0;
+    }
+
+    pthread_mutex_unlock(&d->lock);
+    return rc;
+}
+
+static uint32_t get_le32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/**
+ * @brief Appends a frame to a growing frame list.
+ */
+static int frame_push(struct frame **list, size_t *n, size_t *cap, const char *data, size_t len)
+{
+    if (*n == *cap) {
+        size_t grown_cap = *cap ? *cap * 2 : 64;
+        struct frame *grown = realloc(*list, grown_cap * sizeof(*grown));
+        if (grown == NULL) {
+            return -1;
+        }
+        *list = grown;
+        *cap = grown_cap;
+    }
+    (*list)[*n].data = data;
+    (*list)[*n].len = len;
+    (*n)++;
+    return 0;
+}
+
+/**
+ * @brief Returns the total size of the BGZF block at p, or 0 if p is not one.
+ *
+ * A BGZF block is a gzip member whose extra field holds a "BC" subfield with
+ * the block size minus one.
+ */
+static size_t bgzf_block_size(const unsigned char *p, size_t avail)
+{
+    if (avail < 18 || p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || !(p[3] & 4)) {
+        return 0;
+    }
+    size_t xlen = (size_t)p[10] | (size_t)p[11] << 8;
+    if (12 + xlen > avail) {
+        return 0;
+    }
+
+    const unsigned char *x = p + 12, *end = p + 12 + xlen;
+    while (x + 4 <= end) {
+        size_t slen = (size_t)x[2] | (size_t)x[3] << 8;
+        if (x[0] == 'B' && x[1] == 'C' && slen == 2 && x + 6 <= end) {
+            return ((size_t)x[4] | (size_t)x[5] << 8) + 1;
+        }
+        x += 4 + slen;
+    }
+    return 0;
+}
+
+/**
+ * @brief Splits a bgzip file using its FILE.gzi index.
+ *
+ * The index holds a u64 entry count followed by (compressed offset,
+ * uncompressed offset) u64 pairs for every block after the first. Blocks may
+ * be grouped (an index that lists only some blocks still works), since a
+ * frame is decoded as a run of gzip members.
+ */
+static int gzi_split(const char *data, size_t len, const char *path, struct frame **frames, size_t *count)
+{
+    if (path == NULL) {
+        return -1;
+    }
+    size_t plen = strlen(path);
+    char *gzi = malloc(plen + 5);
+    if (gzi == NULL) {
+        return -1;
+    }
+    memcpy(gzi, path, plen);
+    memcpy(gzi + plen, ".gzi", 5);
+    FILE *f = fopen(gzi, "rb");
+    free(gzi);
+    if (f == NULL) {
+        return -1;
+    }
+
+    struct frame *list = NULL;
+    size_t n = 0, cap = 0, start = 0;
+    unsigned char entry[16];
+    uint64_t entries = 0;
+    int rc = -1;
+
+    if (fread(entry, 1, 8, f) == 8) {
+        for (int i = 7; i >= 0; i--) {
+            entries = entries << 8 | entry[i];
+        }
+        rc = 0;
+    }
+
+    for (uint64_t e = 0; rc == 0 && e < entries; e++) {
+        uint64_t off = 0;
+        if (fread(entry, 1, 16, f) != 16) {
+            rc = -1;
+            break;
+        }
+        for (int i = 7; i >= 0; i--) {
+            off = off << 8 | entry[i];
+        }
+        // A stale index (the file was rewritten) fails these checks.
+        if (off <= start || off >= len || (unsigned char)data[off] != 0x1f ||
+            frame_push(&list, &n, &cap, data + start, (size_t)off - start) < 0) {
+            rc = -1;
+            break;
+        }
+        start = (size_t)off;
+    }
+    if (rc == 0) {
+        rc = frame_push(&list, &n, &cap, data + start, len - start);
+    }
+
+    fclose(f);
+    if (rc < 0) {
+        free(list);
+        return -1;
+    }
+    *frames = list;
+    *count = n;
+    return 0;
+}
+
+/**
+ * @brief Splits a bgzip file by walking its block headers.
+ */
+static int bgzf_split(const char *data, size_t len, struct frame **frames, size_t *count)
+{
+    struct frame *list = NULL;
+    size_t n = 0, cap = 0, off = 0;
+
+    while (off < len) {
+        size_t size = bgzf_block_size((const unsigned char *)data + off, len - off);
+        if (size == 0 || size > len - off || frame_push(&list, &n, &cap, data + off, size) < 0) {
+            free(list);
+            return -1; // Plain gzip (or corrupt): decode it as one stream
+        }
+        off += size;
+    }
+
+    *frames = list;
+    *count = n;
+    return 0;
+}
+
+#ifdef HAVE_ZSTD
+/**
+ * @brief Splits a seekable-zstd file using the seek table at its end.
+ *
+ * The table is a skippable frame ending in a footer of frame count,
+ * descriptor (bit 7: entries carry a checksum) and ZSTD_SEEKABLE_MAGIC. Each
+ * entry holds the compressed and decompressed size of one frame.
+ */
+static int zstd_seek_table_split(const char *data, size_t len, struct frame **frames, size_t *count)
+{
+    const unsigned char *p = (const unsigned char *)data;
+
+    if (len < 8 + ZSTD_SEEKABLE_FOOTER || get_le32(p + len - 4) != ZSTD_SEEKABLE_MAGIC) {
+        return -1;
+    }
+    uint32_t nframes = get_le32(p + len - ZSTD_SEEKABLE_FOOTER);
+    size_t entry_size = (p[len - 5] & 0x80) ? 12 : 8;
+    if (nframes == 0 || nframes > (len - 8 - ZSTD_SEEKABLE_FOOTER) / entry_size) {
+        return -1;
+    }
+    size_t table_size = 8 + (size_t)nframes * entry_size + ZSTD_SEEKABLE_FOOTER;
+    const unsigned char *entry = p + len - table_size + 8;
+
+    struct frame *list = NULL;
+    size_t n = 0, cap = 0, off = 0;
+    for (uint32_t i = 0; i < nframes; i++, entry += entry_size) {
+        size_t size = get_le32(entry);
+        if (size > len - table_size - off || frame_push(&list, &n, &cap, data + off, size) < 0) {
+            free(list);
+            return -1;
+        }
+        off += size;
+    }
+    if (off != len - table_size) {
+        free(list);
+        return -1; // The table does not describe this file
+    }
+
+    *frames = list;
+    *count = n;
+    return 0;
+}
+
+/**
+ * @brief Splits a zstd file by walking its frame headers.
+ */
+static int zstd_walk_split(const char *data, size_t len, struct frame **frames, size_t *count)
+{
+    struct frame *list = NULL;
+    size_t n = 0, cap = 0, off = 0;
+
+    while (off < len) {
+        size_t size = ZSTD_findFrameCompressedSize(data + off, len - off);
+        if (ZSTD_isError(size) || frame_push(&list, &n, &cap, data + off, size) < 0) {
+            free(list);
+            return -1;
+        }
+        off += size;
+    }
+
+    *frames = list;
+    *count = n;
+    return 0;
+}
+#endif
+
+int decoder_split_frames(enum decoder_format format, const char *data, size_t len, const char *path,
+                         struct frame **frames, size_t *count)
+{
+    if (format == DECODER_GZIP) {
+        if (bgzf_block_size((const unsigned char *)data, len) == 0) {
+            return -1;
+        }
+        if (gzi_split(data, len, path, frames, count) == 0) {
+            return 0;
+        }
+        return bgzf_split(data, len, frames, count);
+    }
+#ifdef HAVE_ZSTD
+    if (format == DECODER_ZSTD) {
+        if (zstd_seek_table_split(data, len, frames, count) == 0) {
+            return 0;
+        }
+        return zstd_walk_split(data, len, frames, count);
+    }
+#endif
+    return -1;
+}
+
+/**
+ * @brief Decodes a run of gzip members (one or more bgzip blocks).
+ */
+static int gzip_decode_frame(const struct frame *f, char **out, size_t *out_len)
+{
+    const unsigned char *p = (const unsigned char *)f->data;
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK) {
+        return -1;
+    }
+
+    // ISIZE (the last four bytes) is exact for a single member, a good guess otherwise.
+    // Deflate cannot expand by more than ~1032:1, which bounds a corrupt ISIZE.
+    size_t cap = f->len >= 18 ? get_le32(p + f->len - 4) : 0;
+    if (cap < f->len || cap / 1032 > f->len) {
+        cap = f->len * 4;
+    }
+    if (cap < 4096) {
+        cap = 4096;
+    }
+    char *buf = malloc(cap + 1);
+    size_t used = 0, in_off = 0;
+    int rc = buf ? 0 : -1;
+
+    while (rc == 0) {
+        if (used == cap) {
+            char *grown = realloc(buf, cap * 2 + 1);
+            if (grown == NULL) {
+                rc = -1;
+                break;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+        // zlib counts in uInt, so a frame or buffer past 4 GiB is fed in slices.
+        uInt in_slice = f->len - in_off > UINT32_MAX ? UINT32_MAX : (uInt)(f->len - in_off);
+        uInt out_slice = cap - used > UINT32_MAX ? UINT32_MAX : (uInt)(cap - used);
+        z.next_in = (unsigned char *)p + in_off;
+        z.avail_in = in_slice;
+        z.next_out = (unsigned char *)buf + used;
+        z.avail_out = out_slice;
+
+        int ret = inflate(&z, Z_NO_FLUSH);
+        in_off += in_slice - z.avail_in;
+        used += out_slice - z.avail_out;
+
+        if (ret == Z_STREAM_END) {
+            if (in_off >= f->len || p[in_off] != 0x1f) {
+                break;
+            }
+            inflateReset(&z);
+        } else if (ret != Z_OK && !(ret == Z_BUF_ERROR && z.avail_out == 0)) {
+            rc = -1; // Corrupt, or the member is truncated
+        }
+    }
+
+    inflateEnd(&z);
+    if (rc < 0) {
+        free(buf);
+        return -1;
+    }
+    *out = buf;
+    *out_len = used;
+    return 0;
+}
+
+int decoder_decode_frame(enum decoder_format format, const struct frame *f, char **out, size_t *out_len)
+{
+    if (format == DECODER_GZIP) {
+        return gzip_decode_frame(f, out, out_len);
+    }
+#ifdef HAVE_ZSTD
+    if (format == DECODER_ZSTD) {
+        const unsigned char *p = (const unsigned char *)f->data;
+        *out = NULL;
+        *out_len = 0;
+
+        // Skippable frames (metadata, seek tables) carry no content.
+        if (f->len >= 4 && (p[0] & 0xf0) == 0x50 && p[1] == 0x2a && p[2] == 0x4d && p[3] == 0x18) {
+            return 0;
+        }
+
+        unsigned long long size = ZSTD_getFrameContentSize(f->data, f->len);
+        if (size == ZSTD_CONTENTSIZE_ERROR) {
+            return -1;
+        }
+        if (size != ZSTD_CONTENTSIZE_UNKNOWN) {
+            char *buf = malloc(size ? (size_t)size : 1);
+            if (buf == NULL) {
+                return -1;
+            }
+            size_t ret = ZSTD_decompress(buf, (size_t)size, f->data, f->len);
+            if (ZSTD_isError(ret) || ret != size) {
+                free(buf);
+                return -1;
+            }
+            *out = buf;
+            *out_len = ret;
+            return 0;
+        }
+
+        // Streamed frames do not record their size: grow the buffer as we go.
+        ZSTD_DCtx *dctx = ZSTD_createDCtx();
+        ZSTD_inBuffer in = { f->data, f->len, 0 };
+        ZSTD_outBuffer o = { NULL, 0, 0 };
+        size_t ret = 1;
+        while (dctx != NULL && ret != 0) {
+            if (o.pos == o.size) {
+                size_t cap = o.size ? o.size * 2 : ZSTD_DStreamOutSize() * 4;
+                char *grown = realloc(o.dst, cap);
+                if (grown == NULL) {
+                    break;
+                }
+                o.dst = grown;
+                o.size = cap;
+            }
+            size_t before = in.pos + o.pos;
+            ret = ZSTD_decompressStream(dctx, &o, &in);
+            if (ZSTD_isError(ret) || (ret != 0 && in.pos + o.pos == before)) {
+                break; // Corrupt, or the frame is truncated
+            }
+        }
+        ZSTD_freeDCtx(dctx);
+        if (ret != 0) {
+            free(o.dst);
+            return -1;
+        }
+        *out = o.dst;
+        *out_len = o.pos;
+        return 0;
+    }
+#endif
+    (void)format;
+    (void)f;
+    (void)out;
+    (void)out_len;
+    return -1;
+}
+
+void decoder_stop(struct decoder *d)
+{
+    if (d == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&d->lock);
+    int running = !d->done;
+    d->stop = 1;
+    pthread_cond_broadcast(&d->cond);
+    pthread_mutex_unlock(&d->lock);
+
+    if (running && d->fd >= 0) {
+        pthread_cancel(d->thread); // Only takes effect inside a blocking read(2)
+    }
+    pthread_join(d->thread, NULL);
+
+    decoder_end_stream(d);
+    pthread_mutex_destroy(&d->lock);
+    pthread_cond_destroy(&d->cond);
+    hugepage_free(d->blocks[0], (size_t)DECODER_BLOCKS * DECODER_BLOCK_SIZE);
+    free(d->in_buf);
+    free(d);
+}
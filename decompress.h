@@ -0,0 +1,116 @@
+/**
+ * @file decompress.h
+ * @brief Background decompression of compressed input into reader blocks.
+ *
+ * A decoder runs on its own thread and inflates the input into a small ring
+ * of blocks. The reader consumes one block while the next ones are being
+ * produced, so decompression overlaps with matching.
+ *
+ * Formats made of independent frames (multi-frame or seekable zstd, and
+ * bgzip's gzip blocks) can also be split up front, so that the frames are
+ * decoded by several threads at once, or decoding can start part way in.
+ * Frame boundaries come from an index when one exists (the seekable-zstd
+ * seek table, or bgzip's FILE.gzi), otherwise from walking frame headers.
+ *
+ * zstd support is optional; build with `make ZSTD=1` to enable it.
+ */
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <stddef.h>
+
+#define DECODER_BLOCKS 4          // Blocks in flight between decoder and reader
+#define DECODER_INPUT_SIZE (1 << 18) // 256 KiB compressed read(2) size
+
+enum decoder_format {
+    DECODER_NONE = 0,
+    DECODER_GZIP,
+    DECODER_ZSTD
+};
+
+struct decoder;
+
+/**
+ * @brief One independently decodable frame of a compressed input.
+ */
+struct frame {
+    const char *data;           // Compressed bytes (inside the input mapping)
+    size_t len;
+};
+
+/**
+ * @brief Identifies a compressed format from the first bytes of an input.
+ *
+ * @param data The first bytes of the input.
+ * @param len The number of bytes available.
+ * @return The detected format, or DECODER_NONE for plain input. zstd is
+ * recognised even in a build without zstd support.
+ */
+enum decoder_format decoder_detect(const char *data, size_t len);
+
+/**
+ * @brief Checks whether this build can decompress a format.
+ */
+int decoder_supported(enum decoder_format format);
+
+/**
+ * @brief Returns a human readable name for a format (e.g., "gzip").
+ */
+const char *decoder_name(enum decoder_format format);
+
+/**
+ * @brief Starts decoding an input on a background thread.
+ *
+ * Compressed bytes are taken from `data` first and, once that is exhausted,
+ * read from `fd` (pass -1 when `data` holds the whole input, e.g. a mapping).
+ * `data` is copied if it is not the whole input, so the caller may reuse it.
+ *
+ * @param format The compressed format.
+ * @param fd The descriptor to continue reading from, or -1.
+ * @param data The compressed bytes already available.
+ * @param len The number of bytes in data.
+ * @return A running decoder, or NULL on failure.
+ */
+struct decoder *decoder_start(enum decoder_format format, int fd, const char *data, size_t len);
+
+/**
+ * @brief Returns the next block of decompressed output.
+ *
+ * The previously returned block is handed back to the decoder, so it must not
+ * be referenced after this call.
+ *
+ * @return 1 if a block was returned, 0 at end of input, -1 on a decoding error.
+ */
+int decoder_next_block(struct decoder *d, const char **data, size_t *len);
+
+/**
+ * @brief Splits a fully mapped input into its independent frames.
+ *
+ * @param format The compressed format.
+ * @param data The whole compressed input.
+ * @param len The input length.
+ * @param path The input path, used to find a FILE.gzi index (may be NULL).
+ * @param frames Receives a malloc'd array of frames (caller frees).
+ * @param count Receives the number of frames.
+ * @return 0 on success, -1 if the input cannot be split (e.g., plain gzip) or is corrupt.
+ */
+int decoder_split_frames(enum decoder_format format, const char *data, size_t len, const char *path,
+                         struct frame **frames, size_t *count);
+
+/**
+ * @brief Decodes one frame in the calling thread.
+ *
+ * @param format The compressed format.
+ * @param f The frame to decode.
+ * @param out Receives a malloc'd buffer with the decoded bytes (caller frees).
+ * @param out_len Receives the number of decoded bytes.
+ * @return 0 on success, -1 on a decoding error.
+ */
+int decoder_decode_frame(enum decoder_format format, const struct frame *f, char **out, size_t *out_len);
+
+/**
+ * @brief Stops the decoder thread (even mid-input) and frees its resources.
+ */
+void decoder_stop(struct decoder *d);
+
+#endif // DECOMPRESS_H
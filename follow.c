@@ -0,0 +1,277 @@
+/**
+ * @file follow.c
+ * @brief Implementation of follow mode.
+ */
+
+#include "follow.h"
+#include "hugepage.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t follow_stop;
+
+static void follow_interrupt(int sig)
+{
+    (void)sig;
+    follow_stop = 1;
+}
+
+struct follow {
+    struct search_ctx *ctx;
+    const char *path;
+    int fd;
+    struct stat st;             // Identity of the open file
+    uint64_t offset;            // Next byte to read
+    uint64_t linecount;         // Number of the line that starts the carry (or the next line)
+    uint64_t byte_end;
+    char *buf;
+    char *carry;                // Unfinished last line
+    size_t carry_len;
+    size_t carry_cap;
+    uint64_t carry_offset;      // Offset of the unfinished line
+    int ifd;                    // inotify descriptor, or -1 to poll
+    int wd_file;
+};
+
+/**
+ * @brief Searches one complete line.
+ */
+static void follow_line(struct follow *f, uint64_t offset, const char *line, size_t len)
+{
+    if (offset < f->byte_end && search_in_range(f->ctx, f->linecount)) {
+        f->ctx->line_offset = offset;
+        search_emit_line(f->ctx, f->linecount, line, len, 0);
+    }
+    f->linecount++;
+}
+
+/**
+ * @brief Appends bytes to the unfinished line.
+ */
+static int follow_carry(struct follow *f, const char *data, size_t len)
+{
+    if (f->carry_len + len > f->carry_cap) {
+        size_t cap = f->carry_cap ? f->carry_cap : 4096;
+        while (cap < f->carry_len + len) {
+            cap *= 2;
+        }
+        char *grown = realloc(f->carry, cap);
+        if (grown == NULL) {
+            return -1;
+        }
+        f->carry = grown;
+        f->carry_cap = cap;
+    }
+    memcpy(f->carry + f->carry_len, data, len);
+    f->carry_len += len;
+    return 0;
+}
+
+/**
+ * @brief Reads and searches everything appended since the last call.
+ * @return 0 at end of file, -1 on a read error.
+ */
+static int follow_drain(struct follow *f)
+{
+    int printed = 0;
+
+    for (;;) {
+        ssize_t n = pread(f->fd, f->buf, FOLLOW_BLOCK_SIZE, (off_t)f->offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        const char *data = f->buf;
+        size_t avail = (size_t)n;
+        uint64_t at = f->offset;
+        f->offset += (uint64_t)n;
+
+        const char *nl;
+        while ((nl = memchr(data, '\n', avail)) != NULL) {
+            size_t len = (size_t)(nl - data) + 1;
+            if (f->carry_len == 0) {
+                follow_line(f, at, data, len);
+            } else if (follow_carry(f, data, len) == 0) {
+                follow_line(f, f->carry_offset, f->carry, f->carry_len);
+                f->carry_len = 0;
+            } else {
+                return -1;
+            }
+            data += len;
+            avail -= len;
+            at += len;
+        }
+
+        if (avail > 0) {
+            if (f->carry_len == 0) {
+                f->carry_offset = at;
+            }
+            if (follow_carry(f, data, avail) < 0) {
+                return -1;
+            }
+        }
+        printed = 1;
+    }
+
+    // Results should show up as soon as the lines are written.
+    if (printed) {
+        output_flush(f->ctx->out);
+    }
+    return 0;
+}
+
+/**
+ * @brief Watches the open file for writes and rotation.
+ */
+static void follow_watch(struct follow *f)
+{
+    if (f->ifd >= 0) {
+        f->wd_file = inotify_add_watch(f->ifd, f->path,
+                                       IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+    }
+}
+
+/**
+ * @brief Checks for truncation and rotation, switching to the new file if needed.
+ * @return 1 if reading starts over (truncated or replaced), 0 otherwise.
+ */
+static int follow_check(struct follow *f)
+{
+    struct stat now;
+
+    // Truncated in place (e.g., copytruncate): start over from the beginning.
+    if (fstat(f->fd, &now) == 0 && (uint64_t)now.st_size < f->offset) {
+        fprintf(stderr, "search: %s: file truncated\n", f->path);
+        f->offset = 0;
+        f->carry_len = 0;
+        f->linecount = 1;
+        return 1;
+    }
+
+    // Renamed or deleted and recreated: the old file is drained, so switch over.
+    if (stat(f->path, &now) != 0 || (now.st_ino == f->st.st_ino && now.st_dev == f->st.st_dev)) {
+        return 0;
+    }
+    int fd = open(f->path, O_RDONLY);
+    if (fd < 0) {
+        return 0; // Not there yet; try again on the next event
+    }
+    fprintf(stderr, "search: %s has been replaced; following the new file\n", f->path);
+
+    // The old file's unfinished line will never be completed.
+    if (f->carry_len > 0) {
+        follow_line(f, f->carry_offset, f->carry, f->carry_len);
+        f->carry_len = 0;
+        output_flush(f->ctx->out);
+    }
+
+    if (f->ifd >= 0 && f->wd_file >= 0) {
+        inotify_rm_watch(f->ifd, f->wd_file);
+    }
+    close(f->fd);
+    f->fd = fd;
+    fstat(f->fd, &f->st);
+    f->offset = 0;
+    f->linecount = 1;
+    follow_watch(f);
+    return 1;
+}
+
+/**
+ * @brief Waits for an inotify event (or the poll interval) and discards the events.
+ */
+static void follow_wait(struct follow *f)
+{
+    if (f->ifd < 0) {
+        poll(NULL, 0, FOLLOW_POLL_MS);
+        return;
+    }
+
+    struct pollfd pfd = { .fd = f->ifd, .events = POLLIN };
+    if (poll(&pfd, 1, FOLLOW_POLL_MS) > 0) {
+        // Which event it was does not matter: the file is checked either way.
+        char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        while (read(f->ifd, events, sizeof(events)) > 0) {
+        }
+    }
+}
+
+int follow_file(struct search_ctx *ctx, const char *path, int fd, uint64_t offset, uint64_t linecount,
+                uint64_t byte_end)
+{
+    struct follow f = {
+        .ctx = ctx,
+        .path = path,
+        .offset = offset,
+        .linecount = linecount,
+        .byte_end = byte_end,
+        .fd = fd,
+        .ifd = -1,
+        .wd_file = -1,
+    };
+
+    f.buf = hugepage_alloc(FOLLOW_BLOCK_SIZE);
+    if (f.fd < 0 || f.buf == NULL || fstat(f.fd, &f.st) != 0) {
+        if (f.fd >= 0) {
+            close(f.fd);
+        }
+        hugepage_free(f.buf, FOLLOW_BLOCK_SIZE);
+        return -1;
+    }
+
+    // Watch the directory too, so a file recreated under the same name is noticed.
+    f.ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (f.ifd >= 0) {
+        char dir[PATH_MAX];
+        const char *slash = strrchr(path, '/');
+        if (slash == NULL) {
+            strcpy(dir, ".");
+        } else {
+            size_t len = slash == path ? 1 : (size_t)(slash - path);
+            snprintf(dir, sizeof(dir), "%.*s", (int)len, path);
+        }
+        inotify_add_watch(f.ifd, dir, IN_CREATE | IN_MOVED_TO);
+        follow_watch(&f);
+    }
+
+    // Stop cleanly on Ctrl-C, so the summary is still printed.
+    struct sigaction sa = { .sa_handler = follow_interrupt };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int rc = 0;
+    while (!follow_stop && !ctx->done && !search_past_range(ctx, f.linecount) &&
+           f.offset < byte_end) {
+        if ((rc = follow_drain(&f)) < 0) {
+            break;
+        }
+        if (!follow_check(&f)) {
+            follow_wait(&f);
+        }
+    }
+
+    if (f.ifd >= 0) {
+        close(f.ifd);
+    }
+    close(f.fd);
+    hugepage_free(f.buf, FOLLOW_BLOCK_SIZE);
+    free(f.carry);
+    return rc;
+}
@@ -0,0 +1,37 @@
+/**
+ * @file follow.h
+ * @brief Follow mode (-F): keep searching a file as lines are appended.
+ *
+ * After the existing contents have been searched, the file is watched with
+ * inotify (or polled, where inotify is unavailable) and only the new bytes
+ * are read and searched, with line numbers carrying on from the first pass.
+ * A truncated file is searched again from its start; a file that was renamed
+ * or deleted and recreated (log rotation) is drained and then reopened.
+ */
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+#include <stdint.h>
+
+#include "search.h"
+
+#define FOLLOW_BLOCK_SIZE (1 << 20) // Bytes read per read(2) of new data
+#define FOLLOW_POLL_MS 1000         // Longest wait between checks of the file
+
+/**
+ * @brief Follows a file until interrupted (SIGINT/SIGTERM) or until no later
+ * line can be printed.
+ *
+ * @param ctx The search context; results are flushed after each batch of new lines.
+ * @param path The file to follow.
+ * @param fd The file the first pass searched (a duplicate, taken over and closed), so
+ * a rotation before following starts is still noticed.
+ * @param offset The offset where the first pass stopped (the start of an unfinished line).
+ * @param linecount The number of the line that starts at offset.
+ * @param byte_end Lines starting at or past this offset are not searched (UINT64_MAX for none).
+ * @return 0 when stopped, -1 on a read error.
+ */
+int follow_file(struct search_ctx *ctx, const char *path, int fd, uint64_t offset, uint64_t linecount,
+                uint64_t byte_end);
+
+#endif // FOLLOW_H
@@ -0,0 +1,112 @@
+/**
+ * @file hugepage.c
+ * @brief Implementation of the huge-page scan buffers.
+ */
+
+#define _GNU_SOURCE
+#include "hugepage.h"
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "numa.h"
+
+static int hugepage_enabled = 1;
+static struct hugepage_usage hugepage_counts; // Updated atomically: decoder threads allocate too
+
+/**
+ * @brief Rounds a length up to a whole number of huge pages.
+ */
+static size_t hugepage_round(size_t len)
+{
+    return (len + HUGEPAGE_SIZE - 1) & ~(size_t)(HUGEPAGE_SIZE - 1);
+}
+
+void hugepage_disable(void)
+{
+    hugepage_enabled = 0;
+}
+
+/**
+ * @brief Maps size bytes, on huge pages where possible.
+ */
+static void *hugepage_map(size_t size)
+{
+    if (!hugepage_enabled) {
+        void *buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf == MAP_FAILED) {
+            return NULL;
+        }
+        __atomic_add_fetch(&hugepage_counts.regular, 1, __ATOMIC_RELAXED);
+        return buf;
+    }
+
+#ifdef MAP_HUGETLB
+    // Explicit huge pages only exist if the administrator reserved some.
+    void *huge = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (huge != MAP_FAILED) {
+        __atomic_add_fetch(&hugepage_counts.hugetlb, 1, __ATOMIC_RELAXED);
+        return huge;
+    }
+#endif
+
+    // Transparent huge pages need an aligned range: map one page extra and trim it.
+    char *raw = mmap(NULL, size + HUGEPAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+    char *buf = (char *)(((uintptr_t)raw + HUGEPAGE_SIZE - 1) & ~(uintptr_t)(HUGEPAGE_SIZE - 1));
+    if (buf > raw) {
+        munmap(raw, (size_t)(buf - raw));
+    }
+    if (raw + HUGEPAGE_SIZE > buf) {
+        munmap(buf + size, (size_t)(raw + HUGEPAGE_SIZE - buf));
+    }
+
+#ifdef MADV_HUGEPAGE
+    if (madvise(buf, size, MADV_HUGEPAGE) == 0) {
+        __atomic_add_fetch(&hugepage_counts.transparent, 1, __ATOMIC_RELAXED);
+        return buf;
+    }
+#endif
+    __atomic_add_fetch(&hugepage_counts.regular, 1, __ATOMIC_RELAXED);
+    return buf;
+}
+
+void *hugepage_alloc(size_t len)
+{
+    size_t size = hugepage_round(len ? len : 1);
+    void *buf = hugepage_map(size);
+
+    // Bound before the first touch, so the pages come from the allocating worker's node.
+    if (buf != NULL) {
+        numa_bind_local(buf, size);
+    }
+    return buf;
+}
+
+void hugepage_free(void *buf, size_t len)
+{
+    if (buf != NULL) {
+        munmap(buf, hugepage_round(len ? len : 1));
+    }
+}
+
+void hugepage_advise(void *map, size_t len)
+{
+#ifdef MADV_HUGEPAGE
+    if (hugepage_enabled && len >= HUGEPAGE_SIZE) {
+        madvise(map, len, MADV_HUGEPAGE); // Not supported for files on every kernel; harmless then
+    }
+#else
+    (void)map;
+    (void)len;
+#endif
+}
+
+void hugepage_usage(struct hugepage_usage *usage)
+{
+    usage->hugetlb = __atomic_load_n(&hugepage_counts.hugetlb, __ATOMIC_RELAXED);
+    usage->transparent = __atomic_load_n(&hugepage_counts.transparent, __ATOMIC_RELAXED);
+    usage->regular = __atomic_load_n(&hugepage_counts.regular, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,59 @@
+/**
+ * @file hugepage.h
+ * @brief Scan buffers backed by huge pages.
+ *
+ * Read and decode blocks are walked end to end on every pass, so with 4 KiB
+ * pages a scan takes a TLB miss every few thousand bytes. Buffers are taken
+ * from explicit huge pages (MAP_HUGETLB) when the system has some reserved,
+ * and otherwise are aligned to a huge page and advised with MADV_HUGEPAGE so
+ * transparent huge pages can back them. Mapped input files are advised too,
+ * which helps where the kernel supports huge pages for the page cache.
+ */
+#ifndef HUGEPAGE_H
+#define HUGEPAGE_H
+
+#include <stddef.h>
+
+#define HUGEPAGE_SIZE (2 * 1024 * 1024) // Huge page size buffers are rounded and aligned to
+
+/**
+ * @brief How the buffers allocated so far are backed, for --stats.
+ */
+struct hugepage_usage {
+    unsigned hugetlb;           // Buffers on explicit huge pages
+    unsigned transparent;       // Buffers advised for transparent huge pages
+    unsigned regular;           // Buffers on regular pages
+};
+
+/**
+ * @brief Turns huge pages off for the rest of the run (--no-huge-pages).
+ */
+void hugepage_disable(void);
+
+/**
+ * @brief Allocates a scan buffer, on huge pages where possible.
+ *
+ * @param len The buffer size in bytes.
+ * @return The buffer, or NULL if out of memory. Release it with hugepage_free.
+ */
+void *hugepage_alloc(size_t len);
+
+/**
+ * @brief Releases a buffer from hugepage_alloc.
+ *
+ * @param buf The buffer (may be NULL).
+ * @param len The size it was allocated with.
+ */
+void hugepage_free(void *buf, size_t len);
+
+/**
+ * @brief Asks for huge pages behind a read-only file mapping.
+ */
+void hugepage_advise(void *map, size_t len);
+
+/**
+ * @brief Reports how the buffers allocated so far are backed.
+ */
+void hugepage_usage(struct hugepage_usage *usage);
+
+#endif // HUGEPAGE_H
@@ -0,0 +1,279 @@
+/**
+ * @file lineindex.c
+ * @brief Implementation of the sidecar line index.
+ *
+ * Layout (all integers little-endian):
+ *   magic "SRCHLIDX", u32 version, u32 kind,
+ *   u64 file size, i64 mtime seconds, i64 mtime nanoseconds, u64 inode,
+ *   u64 entry count, then the entries as LEB128 varints.
+ *
+ * Line offsets are stored as the difference to the previous offset, which
+ * keeps most entries to two or three bytes.
+ */
+
+#include "lineindex.h"
+#include "memscan.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LINE_INDEX_HEADER_SIZE 56
+
+char *line_index_path(const char *path)
+{
+    size_t len = strlen(path);
+    char *sidecar = malloc(len + sizeof(LINE_INDEX_SUFFIX));
+    if (sidecar != NULL) {
+        memcpy(sidecar, path, len);
+        memcpy(sidecar + len, LINE_INDEX_SUFFIX, sizeof(LINE_INDEX_SUFFIX));
+    }
+    return sidecar;
+}
+
+static void put_u64(unsigned char *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint64_t get_u64(const unsigned char *p)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+/**
+ * @brief Fills the fixed header for a file's current identity.
+ */
+static void line_index_header(unsigned char *h, const struct stat *st, enum line_index_kind kind, size_t count)
+{
+    memcpy(h, LINE_INDEX_MAGIC, 8);
+    put_u64(h + 8, (uint64_t)LINE_INDEX_VERSION | ((uint64_t)kind << 32));
+    put_u64(h + 16, (uint64_t)st->st_size);
+    put_u64(h + 24, (uint64_t)st->st_mtim.tv_sec);
+    put_u64(h + 32, (uint64_t)st->st_mtim.tv_nsec);
+    put_u64(h + 40, (uint64_t)st->st_ino);
+    put_u64(h + 48, (uint64_t)count);
+}
+
+int line_index_load(const char *path, const struct stat *st, enum line_index_kind kind, struct line_index *idx)
+{
+    memset(idx, 0, sizeof(*idx));
+
+    char *sidecar = line_index_path(path);
+    FILE *f = sidecar ? fopen(sidecar, "rb") : NULL;
+    free(sidecar);
+    if (f == NULL) {
+        return -1;
+    }
+
+    unsigned char h[LINE_INDEX_HEADER_SIZE], expect[LINE_INDEX_HEADER_SIZE];
+    if (fread(h, 1, sizeof(h), f) != sizeof(h)) {
+        fclose(f);
+        return -1;
+    }
+
+    // Everything but the entry count must match the file as it is now.
+    uint64_t count = get_u64(h + 48);
+    line_index_header(expect, st, kind, (size_t)count);
+    if (memcmp(h, expect, sizeof(h)) != 0 || count > (uint64_t)st->st_size + 1) {
+        fclose(f);
+        return -1;
+    }
+
+    idx->values = malloc((count ? count : 1) * sizeof(*idx->values));
+    if (idx->values == NULL) {
+        fclose(f);
+        return -1;
+    }
+
+    uint64_t base = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t v = 0;
+        int shift = 0, c;
+        do {
+            c = getc(f);
+            if (c == EOF || shift > 63) {
+                fclose(f);
+                line_index_free(idx);
+                return -1;
+            }
+            v |= (uint64_t)(c & 0x7f) << shift;
+            shift += 7;
+        } while (c & 0x80);
+
+        if (kind == LINE_INDEX_LINES) {
+            v += base;
+            if (v < base || v > (uint64_t)st->st_size) {
+                fclose(f);
+                line_index_free(idx);
+                return -1;
+            }
+            base = v;
+        }
+        idx->values[i] = v;
+    }
+
+    fclose(f);
+    idx->kind = kind;
+    idx->count = (size_t)count;
+    return 0;
+}
+
+int line_index_save(const char *path, const struct stat *st, const struct line_index *idx)
+{
+    char *sidecar = line_index_path(path);
+    if (sidecar == NULL) {
+        return -1;
+    }
+
+    // Write next to the target and rename, so readers never see a partial index.
+    size_t len = strlen(sidecar);
+    char *tmp = malloc(len + 5);
+    if (tmp == NULL) {
+        free(sidecar);
+        return -1;
+    }
+    memcpy(tmp, sidecar, len);
+    memcpy(tmp + len, ".tmp", 5);
+
+    FILE *f = fopen(tmp, "wb");
+    int rc = -1;
+    if (f != NULL) {
+        unsigned char h[LINE_INDEX_HEADER_SIZE];
+        line_index_header(h, st, idx->kind, idx->count);
+        fwrite(h, 1, sizeof(h), f);
+
+        uint64_t base = 0;
+        for (size_t i = 0; i < idx->count; i++) {
+            uint64_t v = idx->values[i];
+            if (idx->kind == LINE_INDEX_LINES) {
+                v -= base;
+                base = idx->values[i];
+            }
+            do {
+                int byte = (int)(v & 0x7f);
+                v >>= 7;
+                putc(v ? byte | 0x80 : byte, f);
+            } while (v);
+        }
+
+        rc = (ferror(f) | fclose(f)) ? -1 : 0;
+        if (rc == 0 && rename(tmp, sidecar) != 0) {
+            rc = -1;
+        }
+        if (rc != 0) {
+            int saved = errno;
+            unlink(tmp);
+            errno = saved;
+        }
+    }
+
+    free(tmp);
+    free(sidecar);
+    return rc;
+}
+
+void line_index_block_span(const struct line_index *idx, uint64_t lower, uint64_t upper,
+                           size_t *first, size_t *count, uint64_t *lines_before)
+{
+    uint64_t cum = 0;
+    size_t i = 0;
+
+    if (lower < 1) {
+        lower = 1;
+    }
+
+    // Line `lower` starts just after newline lower - 1; find the block holding it.
+    while (i + 1 < idx->count && cum + idx->values[i] < lower - 1) {
+        cum += idx->values[i];
+        i++;
+    }
+    *first = i;
+    *lines_before = cum;
+
+    // Line `upper` ends at newline `upper`; stop after the block holding it.
+    while (i + 1 < idx->count && cum + idx->values[i] < upper) {
+        cum += idx->values[i];
+        i++;
+    }
+    *count = idx->count ? i - *first + 1 : 0;
+}
+
+int line_index_build_lines(const char *data, size_t len, struct line_index *idx)
+{
+    size_t cap = 64;
+    size_t off = 0;
+
+    memset(idx, 0, sizeof(*idx));
+    idx->kind = LINE_INDEX_LINES;
+    idx->values = malloc(cap * sizeof(*idx->values));
+    if (idx->values == NULL) {
+        return -1;
+    }
+
+    for (;;) {
+        uint64_t lines = LINE_INDEX_STRIDE;
+        off += memscan_skip_lines(data + off, len - off, &lines);
+        if (lines != 0 || off == len) {
+            break; // No line starts after the end of the file
+        }
+
+        if (idx->count == cap) {
+            cap *= 2;
+            uint64_t *grown = realloc(idx->values, cap * sizeof(*grown));
+            if (grown == NULL) {
+                line_index_free(idx);
+                return -1;
+            }
+            idx->values = grown;
+        }
+        idx->values[idx->count++] = off;
+    }
+
+    return 0;
+}
+
+void line_index_line_seek(const struct line_index *idx, uint64_t lower,
+                          uint64_t *offset, uint64_t *lines_before)
+{
+    size_t k = lower > 1 ? (size_t)((lower - 1) / LINE_INDEX_STRIDE) : 0;
+
+    if (k > idx->count) {
+        k = idx->count;
+    }
+    *offset = k ? idx->values[k - 1] : 0;
+    *lines_before = (uint64_t)k * LINE_INDEX_STRIDE;
+}
+
+void line_index_offset_seek(const struct line_index *idx, uint64_t target,
+                            uint64_t *offset, uint64_t *lines_before)
+{
+    size_t lo = 0, hi = idx->count;
+
+    // Entries are increasing offsets; count those at or before the target.
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idx->values[mid] <= target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *offset = lo ? idx->values[lo - 1] : 0;
+    *lines_before = (uint64_t)lo * LINE_INDEX_STRIDE;
+}
+
+void line_index_free(struct line_index *idx)
+{
+    free(idx->values);
+    idx->values = NULL;
+    idx->count = 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file lineindex.h
+ * @brief Sidecar line index (FILE.lidx) for starting scans part way into a file.
+ *
+ * For block-compressed archives (bgzip, multi-frame or seekable zstd) the
+ * index stores the number of newlines in every independently decodable
+ * block, so a --range query can start decompressing at the block that holds
+ * its first line instead of at the start of the archive.
+ *
+ * For plain files it stores the byte offset of every LINE_INDEX_STRIDE-th
+ * line (delta-encoded on disk), so a --range query can jump close to its
+ * first line and only count the remainder.
+ *
+ * The sidecar records the size, mtime and inode of the file it was built
+ * from and is ignored as soon as any of them differ.
+ */
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define LINE_INDEX_SUFFIX ".lidx"
+#define LINE_INDEX_MAGIC "SRCHLIDX"
+#define LINE_INDEX_VERSION 1
+#define LINE_INDEX_STRIDE 4096      // Lines between offsets in a plain-file index
+
+enum line_index_kind {
+    LINE_INDEX_BLOCKS = 1,      // Newline count per compressed block
+    LINE_INDEX_LINES = 2        // Byte offset of every LINE_INDEX_STRIDE-th line
+};
+
+struct line_index {
+    enum line_index_kind kind;
+    size_t count;               // Number of entries
+    uint64_t *values;           // Per-kind entries (newlines per block, or line offsets)
+};
+
+/**
+ * @brief Builds the sidecar path for an input (FILE + ".lidx").
+ * @return A malloc'd path, or NULL if out of memory.
+ */
+char *line_index_path(const char *path);
+
+/**
+ * @brief Loads the sidecar for an input if it exists and is still valid.
+ *
+ * @param path The indexed file.
+ * @param st The current stat of the indexed file.
+ * @param kind The kind of index expected.
+ * @param idx Receives the index.
+ * @return 0 on success, -1 if missing, stale, of another kind or corrupt.
+ */
+int line_index_load(const char *path, const struct stat *st, enum line_index_kind kind, struct line_index *idx);
+
+/**
+ * @brief Writes the sidecar for an input.
+ *
+ * @param path The indexed file.
+ * @param st The stat of the indexed file at the time the index was computed.
+ * @param idx The index to store.
+ * @return 0 on success, -1 on failure (errno is set).
+ */
+int line_index_save(const char *path, const struct stat *st, const struct line_index *idx);
+
+/**
+ * @brief Picks the blocks a line range needs from a per-block index.
+ *
+ * @param idx A LINE_INDEX_BLOCKS index.
+ * @param lower The first line wanted (1-based).
+ * @param upper The last line wanted.
+ * @param first Receives the first block to decode.
+ * @param count Receives the number of blocks to decode.
+ * @param lines_before Receives the newlines in the blocks before *first.
+ */
+void line_index_block_span(const struct line_index *idx, uint64_t lower, uint64_t upper,
+                           size_t *first, size_t *count, uint64_t *lines_before);
+
+/**
+ * @brief Builds a plain-file index from the file's contents.
+ *
+ * Entry k is the offset of line (k + 1) * LINE_INDEX_STRIDE + 1.
+ *
+ * @param data The file contents.
+ * @param len The file length.
+ * @param idx Receives the index.
+ * @return 0 on success, -1 if out of memory.
+ */
+int line_index_build_lines(const char *data, size_t len, struct line_index *idx);
+
+/**
+ * @brief Finds the indexed line closest to (at or before) a wanted line.
+ *
+ * @param idx A LINE_INDEX_LINES index.
+ * @param lower The first line wanted (1-based).
+ * @param offset Receives the byte offset of the indexed line.
+ * @param lines_before Receives the number of lines before that offset.
+ */
+void line_index_line_seek(const struct line_index *idx, uint64_t lower,
+                          uint64_t *offset, uint64_t *lines_before);
+
+/**
+ * @brief Finds the indexed line closest to (at or before) a byte offset.
+ *
+ * @param idx A LINE_INDEX_LINES index.
+ * @param target The byte offset.
+ * @param offset Receives the byte offset of the indexed line.
+ * @param lines_before Receives the number of lines before that offset.
+ */
+void line_index_offset_seek(const struct line_index *idx, uint64_t target,
+                            uint64_t *offset, uint64_t *lines_before);
+
+/**
+ * @brief Releases the entries of an index.
+ */
+void line_index_free(struct line_index *idx);
+
+#endif // LINEINDEX_H
@@ -6,113 +6,395 @@
  * search/print logic for improved efficiency and maintainability.
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
-#include <ctype.h>
 #include <getopt.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "range.h"
+#include "reader.h"
+#include "output.h"
+#include "search.h"
+#include "parallel.h"
+#include "lineindex.h"
+#include "memscan.h"
+#include "follow.h"
+#include "hugepage.h"
+#include "stats.h"
+#include "scan.h"
+#include "pool.h"
+#include "pipeline.h"
+#include "query.h"
+#include "trigram.h"
 #include "nerror.h"
 
 // --- Constants and Definitions ---
 
-#define MAX_LINE_LENGTH 2048
 #define MAX_TERM_LENGTH 128
 
-// Option bitmasks
-#define OPTION_IGNORE 	(1 << 0) // 0b00000001
-#define OPTION_ISOLATE 	(1 << 1) // 0b00000010
-#define OPTION_LINES	(1 << 2) // 0b00000100
-#define OPTION_RANGE	(1 << 3) // 0b00001000
-#define OPTION_REMOVE	(1 << 4) // 0b00010000
-#define OPTION_SAVE	    (1 << 5) // 0b00100000
+// Long-only options
+#define LONGOPT_BUILD_LINE_INDEX 256
+#define LONGOPT_BINARY_FILES 257
+#define LONGOPT_BYTE_RANGE 258
+#define LONGOPT_STATS 259
+#define LONGOPT_NO_HUGE_PAGES 260
+#define LONGOPT_RECURSIVE 261
+#define LONGOPT_THREADS 262
+#define LONGOPT_QUERIES 263
+#define LONGOPT_INDEX 264
 
-// --- Utility Functions ---
+// --- Main Program ---
+
+void print_help(void) {
+    puts("Search help:\n\tUSAGE: search [OPTION]... TERM [FILE]...");
+    puts("\n\tWith no FILE, or when FILE is -, read standard input (with --recursive, search the current directory).");
+    puts("\tSeveral FILEs are searched in parallel; each result starts with its file name, in the order the FILEs were given.");
+    puts("\n\t-h, --help\t\tShow this help dialog");
+    puts("\t-i, --ignore-case\tSearch is not case sensitive");
+    puts("\t-I, --isolate\t\tOnly return a word where it is an exact match (not part of a compound word).");
+    puts("\t-l, --lines\t\tDisplay line numbers and the starting position of the word.");
+    puts("\t-r, --range NUM-NUM\tDisplay results only from given ranges of lines (e.g., -r 50-75, -r 1-10,500-600,90000- or -r -100000- for the last lines).");
+    puts("\t\t\t\tNumbers may end in K, M, G or T (powers of 1024) or KB, MB, GB or TB (powers of 1000), e.g. -r 10M-12M.");
+    puts("\t--byte-range START-END\tOnly search the lines that begin between two byte offsets (END may be left out), and show each line's offset.");
+    puts("\t-R, --remove-dupes\tOnly shows the line once, regardless of matches (Not fully implemented yet).");
+    puts("\t-s, --save FILE\t\tSave results to a file.");
+    puts("\t--recursive\t\tSearch every file under each FILE (a directory), naming the file in front of each result.");
+    puts("\t--threads N\t\tSearch on N threads (default: the usable cores).");
+    puts("\t-F, --follow\t\tKeep searching FILE as lines are appended, following it across rotation, until interrupted.");
+    puts("\t-a, --text\t\tSearch binary input as if it were text (same as --binary-files=text).");
+    puts("\t--binary-files=TYPE\tHandle input with NUL bytes as skip (default), matches or text.");
+    puts("\t--no-huge-pages\t\tAllocate scan buffers on regular pages only.");
+    puts("\t--stats\t\t\tPrint timing, buffer and dTLB miss statistics when done.");
+    puts("\t--build-line-index FILE\tWrite FILE.lidx so --range can start part way into FILE (plain, bgzip or zstd).");
+    puts("\t--index FILE\t\tWrite FILE.tidx, a trigram index that later searches of FILE (plain, unchanged) use to read only the blocks that can match.");
+    puts("\t--queries QFILE\t\tRun every query in QFILE (one per line: TERM with its own -i, -I, -l, -R, -r and -s) in a single pass over FILE.");
+    puts("\t\t\t\tResults of queries without -s are tagged \"QUERY n: \" and grouped in query order; no TERM is given on the command line.");
+    puts("\n\tEG: search Port /etc/ssh/sshd_config | grep 22");
+}
+
+/**
+ * @brief Prints the status lines of the options that shape the results.
+ *
+ * @param option_field The option field flags.
+ * @param ranges The parsed --range list.
+ * @param tail_numbered Zero if a tail range was resolved without counting its line numbers.
+ */
+static void print_option_status(uint8_t option_field, const struct range_list *ranges, int tail_numbered)
+{
+    if (option_field & OPTION_ISOLATE) fprintf(stderr, "Isolating matches...\n");
+    if (option_field & OPTION_IGNORE) fprintf(stderr, "Ignoring cases...\n");
+    if (option_field & OPTION_LINES) fprintf(stderr, "Including line numbers/positions...\n");
+    if (option_field & OPTION_REMOVE) fprintf(stderr, "Removing duplicate lines...\n");
+    if (option_field & OPTION_RANGE) {
+        fprintf(stderr, "Showing results in a range: ");
+        if (ranges->tail > 0 && !tail_numbered) {
+            // The tail's line numbers were never counted
+            fprintf(stderr, "last %llu lines", (unsigned long long)ranges->tail);
+        } else {
+            for (size_t i = 0; i < ranges->count; i++) {
+                if (ranges->items[i].high == RANGE_OPEN_END) {
+                    fprintf(stderr, "%s%llu-", i ? "," : "", (unsigned long long)ranges->items[i].low);
+                } else {
+                    fprintf(stderr, "%s%llu-%llu", i ? "," : "", (unsigned long long)ranges->items[i].low,
+                            (unsigned long long)ranges->items[i].high);
+                }
+            }
+        }
+        fprintf(stderr, "...\n");
+    }
+}
+
+/**
+ * @brief Prints the status line of the thread count and buffer budget, and
+ * the limits they were derived from.
+ *
+ * @param threads The number of threads in use.
+ * @param threads_set Non-zero if the count came from --threads.
+ */
+static void print_limits(unsigned threads, int threads_set)
+{
+    const struct parallel_limits *limits = parallel_limits();
+
+    fprintf(stderr, "Threads: %u", threads);
+    if (threads_set) {
+        fprintf(stderr, " (--threads)");
+    } else if (limits->cgroup_cpus > 0) {
+        fprintf(stderr, " (%u CPUs allowed, cgroup cpu.max %.2f CPUs)", limits->affinity_cpus,
+                limits->cgroup_cpus);
+    } else {
+        fprintf(stderr, " (%u CPUs allowed)", limits->affinity_cpus);
+    }
+    if (limits->buffer_budget == UINT64_MAX) {
+        fprintf(stderr, "; buffer budget: unlimited\n");
+    } else {
+        fprintf(stderr, "; buffer budget: %llu MiB (1/%d of cgroup memory.max %llu MiB)\n",
+                (unsigned long long)(limits->buffer_budget >> 20), PARALLEL_MEMORY_SHARE,
+                (unsigned long long)(limits->cgroup_memory >> 20));
+    }
+}
+
+/**
+ * @brief Closes the save file, if any, and prints the result count.
+ *
+ * @param write_failed Non-zero if writing the results already failed.
+ * @return 0 on success, -1 if the results could not be written (reported instead of the count).
+ */
+static int print_summary(uint64_t results, const char *save_filepath, FILE *file_stream, int write_failed)
+{
+    if (save_filepath != NULL && fclose(file_stream) != 0) {
+        write_failed = 1;
+    }
+    if (write_failed) {
+        fprintf(stderr, "search: Error while writing results.\n");
+        return -1;
+    }
+    if (save_filepath != NULL) {
+        fprintf(stderr, "\n%llu results written to %s.\n", (unsigned long long)results, save_filepath);
+    } else {
+        fprintf(stderr, "\n%llu results written to stdout.\n", (unsigned long long)results);
+    }
+    return 0;
+}
+
+/**
+ * @brief Opens the search file, reporting why it cannot be searched.
+ * @return 0 on success, -1 after printing the error.
+ */
+static int open_search_file(struct reader *reader, const char *path)
+{
+    if (reader_open(reader, path) == 0) {
+        return 0;
+    }
+    if (errno == ENOTSUP) {
+        fprintf(stderr, "search: %s: %s\n", strcmp(path, "-") == 0 ? "(standard input)" : path,
+                reader_strerror(errno));
+    } else {
+        fprintf(stderr, "search: Could not open search file.\n");
+    }
+    return -1;
+}
 
 /**
- * @brief Checks if a character is a non-word boundary character (part of a word).
- * @param c The character to check.
- * @return 1 if c is a letter, digit, or underscore, 0 otherwise.
+ * @brief Writes the FILE.lidx sidecar: the newline count of every block for
+ * block-compressed input, or the offset of every LINE_INDEX_STRIDE-th line
+ * for a plain file.
+ *
+ * @param path The block-compressed file to index.
+ * @return The process exit status.
  */
-int is_word_char(char c) {
-    return isalnum((unsigned char)c) || c == '_';
+static int build_line_index(const char *path)
+{
+    struct reader reader;
+    FAIL_IF_R_M(strcmp(path, "-") == 0, 1, stderr, "ERROR: A line index can only be built for a named file.\n");
+    if (open_search_file(&reader, path) < 0) {
+        return 1;
+    }
+
+    struct stat st;
+    if (fstat(reader.fd, &st) != 0 ||
+        (reader.frames == NULL && (reader.format != DECODER_NONE || !reader.mapped))) {
+        fprintf(stderr, "ERROR: A line index needs a plain file or a block-compressed input (bgzip, multi-frame or seekable zstd).\n");
+        reader_close(&reader);
+        return 1;
+    }
+
+    if (reader.frames == NULL) {
+        fprintf(stderr, "Indexing every %d lines of %s...\n", LINE_INDEX_STRIDE, path);
+
+        struct line_index idx;
+        int rc = 1;
+        if (line_index_build_lines(reader.block, reader.block_len, &idx) < 0) {
+            fprintf(stderr, "search: Out of memory.\n");
+        } else if (line_index_save(path, &st, &idx) < 0) {
+            fprintf(stderr, "search: Could not write line index.\n");
+        } else {
+            fprintf(stderr, "Line index written to %s%s.\n", path, LINE_INDEX_SUFFIX);
+            rc = 0;
+        }
+
+        line_index_free(&idx);
+        reader_close(&reader);
+        return rc;
+    }
+
+    fprintf(stderr, "Indexing %zu %s blocks of %s...\n", reader.frame_count, decoder_name(reader.format), path);
+
+    struct line_index idx = {
+        .kind = LINE_INDEX_BLOCKS,
+        .count = reader.frame_count,
+        .values = malloc(reader.frame_count * sizeof(uint64_t)),
+    };
+    int rc = 1;
+    if (idx.values == NULL) {
+        fprintf(stderr, "search: Out of memory.\n");
+    } else if (parallel_count_frames(reader.format, reader.frames, reader.frame_count,
+                                     parallel_default_threads(), idx.values) < 0) {
+        fprintf(stderr, "search: Error while reading search file.\n");
+    } else if (line_index_save(path, &st, &idx) < 0) {
+        fprintf(stderr, "search: Could not write line index.\n");
+    } else {
+        fprintf(stderr, "Line index written to %s%s.\n", path, LINE_INDEX_SUFFIX);
+        rc = 0;
+    }
+
+    line_index_free(&idx);
+    reader_close(&reader);
+    return rc;
 }
 
 /**
- * @brief Searches for a term within a line, respecting case-sensitivity and isolation.
+ * @brief Runs every query of a queries file over one input in a single pass.
  *
- * @param line The line buffer to search.
- * @param term The search term.
- * @param options The option field flags.
- * @return A pointer to the start of the match in the line, or NULL if no match is found.
+ * @param queries_path The queries file.
+ * @param search_file The input, or "-" for standard input.
+ * @param save_filepath Where queries without -s write (NULL for stdout).
+ * @param binary_mode What to do with binary input (enum binary_mode).
+ * @param show_stats Print the statistics when done.
+ * @return The process exit status.
  */
-char *search_line(const char *line, const char *term, uint8_t options)
+static int run_queries(const char *queries_path, const char *search_file, const char *save_filepath,
+                       int binary_mode, int show_stats)
 {
-    size_t term_len = strlen(term);
-    const char *current_line_ptr = line;
-    const char *match_ptr = NULL;
-
-    // The inner search loop
-    while (*current_line_ptr != '\0') {
-        int match = 1;
-        
-        // 1. Check if the first character matches (with optional case-insensitivity)
-        if (!((options & OPTION_IGNORE) ? (toupper(*current_line_ptr) == toupper(*term)) : (*current_line_ptr == *term))) {
-            current_line_ptr++;
-            continue;
+    struct query_set set;
+    if (query_load(queries_path, &set) < 0) {
+        return 1;
+    }
+    for (size_t i = 0; i < set.count; i++) {
+        if (strlen(set.items[i].term) >= MAX_TERM_LENGTH) {
+            fprintf(stderr, "ERROR: %s:%zu: Search term is too long.\n", queries_path, set.items[i].line);
+            query_free(&set);
+            return 1;
+        }
+        if (save_filepath != NULL && set.items[i].save_path != NULL &&
+            strcmp(save_filepath, set.items[i].save_path) == 0) {
+            fprintf(stderr, "ERROR: %s:%zu: %s is also the --save file.\n", queries_path, set.items[i].line,
+                    save_filepath);
+            query_free(&set);
+            return 1;
         }
+    }
 
-        // 2. Check if the remaining characters match
-        for (size_t i = 1; i < term_len; i++) {
-            if (!((options & OPTION_IGNORE) ? (toupper(current_line_ptr[i]) == toupper(term[i])) : (current_line_ptr[i] == term[i]))) {
-                match = 0;
-                break;
-            }
+    struct stats stats;
+    if (show_stats) {
+        stats_start(&stats);
+    }
+
+    struct reader reader;
+    if (open_search_file(&reader, search_file) < 0) {
+        query_free(&set);
+        return 1;
+    }
+    int binary = 0;
+    if (binary_mode != BINARY_TEXT) {
+        const char *head;
+        size_t headlen;
+        binary = reader_peek(&reader, &head, &headlen) == 0 && memscan_has_nul(head, headlen);
+    }
+
+    FILE *file_stream = stdout;
+    if (save_filepath != NULL) {
+        file_stream = fopen(save_filepath, "w");
+        if (file_stream == NULL) {
+            fprintf(stderr, "search: Could not open save file.\n");
+            reader_close(&reader);
+            query_free(&set);
+            return 1;
         }
+    }
 
-        if (match) {
-            // 3. Match found. Now check for isolation if required.
-            if (options & OPTION_ISOLATE) {
-                
-                // Check character immediately before the match (if it exists)
-                int start_ok = (current_line_ptr == line) || !is_word_char(*(current_line_ptr - 1));
-                
-                // Check character immediately after the match (if it exists)
-                int end_ok = (current_line_ptr[term_len] == '\0' || !is_word_char(current_line_ptr[term_len]));
-                
-                if (start_ok && end_ok) {
-                    match_ptr = current_line_ptr;
-                    // We found an isolated match, return the pointer
-                    return (char *)match_ptr;
-                }
-            } else {
-                // Not isolated search, any match is fine
-                match_ptr = current_line_ptr;
-                return (char *)match_ptr;
-            }
+    const char *display_name = strcmp(search_file, "-") == 0 ? "(standard input)" : search_file;
+    if (query_open(&set, file_stream, display_name, binary) < 0) {
+        query_free(&set);
+        if (save_filepath != NULL) {
+            fclose(file_stream);
+        }
+        reader_close(&reader);
+        return 1;
+    }
+
+    fprintf(stderr, "Searching for %zu queries from %s in %s\n", set.count, queries_path, display_name);
+    if (reader.format != DECODER_NONE) {
+        fprintf(stderr, "Decompressing %s input once for every query...\n", decoder_name(reader.format));
+    }
+    if (binary && binary_mode == BINARY_SKIP) {
+        fprintf(stderr, "Skipping binary file %s (use --binary-files=text to search it)...\n", display_name);
+    } else if (binary) {
+        fprintf(stderr, "Binary file: only reporting whether it matches...\n");
+    }
+    if (save_filepath != NULL) fprintf(stderr, "Saving tagged results to %s...\n", save_filepath);
+    fputc('\n', stderr);
+
+    int rc = 0;
+    if (!(binary && binary_mode == BINARY_SKIP)) {
+        rc = query_scan(&set, &reader);
+        if (rc < 0) {
+            fprintf(stderr, "search: Error while reading search file.\n");
         }
-        
-        // Move to the next character to start the next comparison
-        current_line_ptr++;
     }
+    int write_failed = query_finish(&set, file_stream) < 0;
+    reader_close(&reader);
 
-    return NULL; // No match found in the entire line
+    // One count per query, then where the tagged ones went.
+    uint64_t tagged = 0;
+    fputc('\n', stderr);
+    for (size_t i = 0; i < set.count; i++) {
+        struct query *q = &set.items[i];
+        if (q->save_path != NULL) {
+            fprintf(stderr, "QUERY %zu (\"%s\"): %llu results written to %s.\n", i + 1, q->term,
+                    (unsigned long long)q->ctx.results, q->save_path);
+        } else {
+            fprintf(stderr, "QUERY %zu (\"%s\"): %llu results.\n", i + 1, q->term,
+                    (unsigned long long)q->ctx.results);
+            tagged += q->ctx.results;
+        }
+    }
+    query_free(&set);
+    if (print_summary(tagged, save_filepath, file_stream, write_failed) < 0) {
+        rc = -1;
+    }
+    if (show_stats) {
+        stats_report(&stats, stderr);
+    }
+    return rc < 0 ? 1 : 0;
 }
 
-// --- Main Program ---
+/**
+ * @brief Writes the FILE.tidx sidecar: the blocks of a plain file that hold
+ * each (case-folded) trigram.
+ *
+ * @param path The plain file to index.
+ * @return The process exit status.
+ */
+static int build_trigram_index(const char *path)
+{
+    struct reader reader;
+    FAIL_IF_R_M(strcmp(path, "-") == 0, 1, stderr, "ERROR: A trigram index can only be built for a named file.\n");
+    if (open_search_file(&reader, path) < 0) {
+        return 1;
+    }
 
-void print_help(void) {
-    puts("Search help:\n\tUSAGE: search [OPTION]... TERM FILE");
-    puts("\n\t-h, --help\t\tShow this help dialog");
-    puts("\t-i, --ignore-case\tSearch is not case sensitive");
-    puts("\t-I, --isolate\t\tOnly return a word where it is an exact match (not part of a compound word).");
-    puts("\t-l, --lines\t\tDisplay line numbers and the starting position of the word.");
-    puts("\t-r, --range NUM-NUM\tDisplay results only from a given range of lines (e.g., -r 50-75).");
-    puts("\t-R, --remove-dupes\tOnly shows the line once, regardless of matches (Not fully implemented yet).");
-    puts("\t-s, --save FILE\t\tSave results to a file.");
-    puts("\n\tEG: search Port /etc/ssh/sshd_config | grep 22");
+    struct stat st;
+    if (fstat(reader.fd, &st) != 0 || reader.format != DECODER_NONE || !reader.mapped) {
+        fprintf(stderr, "ERROR: A trigram index needs a plain (uncompressed) regular file.\n");
+        reader_close(&reader);
+        return 1;
+    }
+
+    fprintf(stderr, "Indexing the trigrams of %s in %d KiB blocks...\n", path, TRIGRAM_BLOCK_SIZE >> 10);
+    int rc = 1;
+    if (trigram_index_build(path, &st, reader.map, reader.map_len) < 0) {
+        fprintf(stderr, "search: Could not write trigram index: %s\n", strerror(errno));
+    } else {
+        fprintf(stderr, "Trigram index written to %s%s.\n", path, TRIGRAM_INDEX_SUFFIX);
+        rc = 0;
+    }
+
+    reader_close(&reader);
+    return rc;
 }
 
 int main(int argc, char *argv[])
@@ -123,11 +405,22 @@ int main(int argc, char *argv[])
     uint8_t option_field = 0;
     char *save_filepath = NULL;
     char *range_arg = NULL;
+    char *byte_range_arg = NULL;
     char *search_term = NULL;
     char *search_file = NULL;
 
-    int lowerrange = 0;
-    int upperrange = 0;
+    uint64_t lowerrange = 0;
+    uint64_t upperrange = 0;
+    uint64_t byte_start = 0;
+    uint64_t byte_end = UINT64_MAX;
+    int binary_mode = BINARY_SKIP;
+    int binary_set = 0;
+    int show_stats = 0;
+    int huge_pages = 1;
+    int recursive = 0;
+    unsigned threads = parallel_default_threads();
+    int threads_set = 0;
+    char *queries_path = NULL;
 
     // getopt_long configuration
     int c;
@@ -139,12 +432,23 @@ int main(int argc, char *argv[])
         {"range", required_argument, 0, 'r'},
         {"remove-dupes", no_argument, 0, 'R'},
         {"save", required_argument, 0, 's'},
+        {"follow", no_argument, 0, 'F'},
+        {"build-line-index", required_argument, 0, LONGOPT_BUILD_LINE_INDEX},
+        {"text", no_argument, 0, 'a'},
+        {"binary-files", required_argument, 0, LONGOPT_BINARY_FILES},
+        {"byte-range", required_argument, 0, LONGOPT_BYTE_RANGE},
+        {"stats", no_argument, 0, LONGOPT_STATS},
+        {"no-huge-pages", no_argument, 0, LONGOPT_NO_HUGE_PAGES},
+        {"recursive", no_argument, 0, LONGOPT_RECURSIVE},
+        {"threads", required_argument, 0, LONGOPT_THREADS},
+        {"queries", required_argument, 0, LONGOPT_QUERIES},
+        {"index", required_argument, 0, LONGOPT_INDEX},
         {0, 0, 0, 0}
     };
     int option_index = 0;
     
     // Parse arguments using getopt_long
-    while ((c = getopt_long(argc, argv, "hIiIr:lRs:", long_options, &option_index)) != -1) {
+    while ((c = getopt_long(argc, argv, "aFhIiIr:lRs:", long_options, &option_index)) != -1) {
         switch (c) {
             case 'h':
                 print_help();
@@ -175,6 +479,67 @@ int main(int argc, char *argv[])
                 save_filepath = optarg;
                 option_field |= OPTION_SAVE;
                 break;
+            case 'F':
+                FAIL_IF_R_M(option_field & OPTION_FOLLOW, 1, stderr, "ERROR: You can only employ a flag once (--follow)\n");
+                option_field |= OPTION_FOLLOW;
+                break;
+            case 'a':
+                FAIL_IF_R_M(binary_set, 1, stderr, "ERROR: You can only employ a flag once (--text/--binary-files)\n");
+                binary_mode = BINARY_TEXT;
+                binary_set = 1;
+                break;
+            case LONGOPT_BINARY_FILES:
+                FAIL_IF_R_M(binary_set, 1, stderr, "ERROR: You can only employ a flag once (--text/--binary-files)\n");
+                if (strcmp(optarg, "skip") == 0) {
+                    binary_mode = BINARY_SKIP;
+                } else if (strcmp(optarg, "matches") == 0) {
+                    binary_mode = BINARY_MATCHES;
+                } else if (strcmp(optarg, "text") == 0) {
+                    binary_mode = BINARY_TEXT;
+                } else {
+                    fprintf(stderr, "ERROR: Invalid --binary-files type. Please use skip, matches or text.\n");
+                    return 1;
+                }
+                binary_set = 1;
+                break;
+            case LONGOPT_BYTE_RANGE:
+                FAIL_IF_R_M(option_field & OPTION_BYTES, 1, stderr, "ERROR: You can only employ a flag once (--byte-range)\n");
+                byte_range_arg = optarg;
+                option_field |= OPTION_BYTES;
+                break;
+            case LONGOPT_STATS:
+                FAIL_IF_R_M(show_stats, 1, stderr, "ERROR: You can only employ a flag once (--stats)\n");
+                show_stats = 1;
+                break;
+            case LONGOPT_NO_HUGE_PAGES:
+                FAIL_IF_R_M(!huge_pages, 1, stderr, "ERROR: You can only employ a flag once (--no-huge-pages)\n");
+                huge_pages = 0;
+                hugepage_disable();
+                break;
+            case LONGOPT_RECURSIVE:
+                FAIL_IF_R_M(recursive, 1, stderr, "ERROR: You can only employ a flag once (--recursive)\n");
+                recursive = 1;
+                break;
+            case LONGOPT_THREADS: {
+                FAIL_IF_R_M(threads_set, 1, stderr, "ERROR: You can only employ a flag once (--threads)\n");
+                char *end;
+                unsigned long n = strtoul(optarg, &end, 10);
+                FAIL_IF_R_M(*optarg == '\0' || *end != '\0' || n < 1 || n > PARALLEL_MAX_THREADS, 1, stderr,
+                            "ERROR: Invalid thread count. Please use a number from 1 to 1024.\n");
+                threads = (unsigned)n;
+                threads_set = 1;
+                break;
+            }
+            case LONGOPT_QUERIES:
+                FAIL_IF_R_M(queries_path != NULL, 1, stderr, "ERROR: You can only employ a flag once (--queries)\n");
+                queries_path = optarg;
+                break;
+            case LONGOPT_BUILD_LINE_INDEX:
+                FAIL_IF_R_M(argc - optind > 0, 1, stderr, "ERROR: --build-line-index takes only a FILE\n");
+                return build_line_index(optarg);
+            case LONGOPT_INDEX:
+                FAIL_IF_R_M(argc - optind > 0, 1, stderr, "ERROR: --index takes only a FILE\n");
+                return build_trigram_index(optarg);
             case '?': // getopt_long handles unknown option errors and prints a message
                 return 1;
             default:
@@ -182,46 +547,205 @@ int main(int argc, char *argv[])
         }
     }
 
+    // --- Queries File ---
+
+    // Every query brings its own TERM and options; only FILE is on the command line.
+    if (queries_path != NULL) {
+        FAIL_IF_R_M(option_field & ~OPTION_SAVE, 1, stderr,
+                    "ERROR: With --queries, give -i, -I, -l, -R and -r in each query; --follow and --byte-range cannot be used.\n");
+        FAIL_IF_R_M(recursive || argc - optind > 1, 1, stderr, "ERROR: --queries searches a single FILE.\n");
+        return run_queries(queries_path, argc > optind ? argv[optind] : "-", save_filepath, binary_mode,
+                           show_stats);
+    }
+
     // --- Positional Argument Checks (TERM and FILE) ---
     
-    // We expect exactly two non-option arguments left: TERM and FILE
-    if (argc - optind < 2) {
-        if (argc - optind == 1) {
-            fprintf(stderr, "ERROR: Missing search file path.\n");
-        } else {
-            fprintf(stderr, "USAGE: search [OPTION]... TERM FILE\n");
-            fprintf(stderr, "Try 'search --help' for more information\n");
-        }
+    // We expect TERM and any number of FILEs; no FILE (or "-") means standard input
+    if (argc - optind < 1) {
+        fprintf(stderr, "USAGE: search [OPTION]... TERM [FILE]...\n");
+        fprintf(stderr, "Try 'search --help' for more information\n");
         return 1;
     }
     
     search_term = argv[optind];
-    search_file = argv[optind + 1];
+    char *current_dir[] = { "." };
+    char **file_paths = argv + optind + 1;
+    size_t file_count = (size_t)(argc - optind - 1);
+    if (recursive && file_count == 0) {
+        file_paths = current_dir;
+        file_count = 1;
+    }
+    int multi = recursive || file_count > 1; // Searched on the thread pool
+    search_file = file_count == 1 ? file_paths[0] : "-";
+    FAIL_IF_R_M((option_field & OPTION_FOLLOW) && !multi && strcmp(search_file, "-") == 0, 1, stderr,
+                "ERROR: --follow needs a FILE.\n");
 
     // --- Range Processing ---
 
+    struct range_list ranges = {0};
     if (option_field & OPTION_RANGE) {
-        lowerrange = get_low_range(range_arg);
-        upperrange = get_high_range(range_arg);
-        
         // Handle range parsing errors
-        if (lowerrange < 0 || upperrange < 0) {
-            fprintf(stderr, "ERROR: Invalid range format. Please use NUM-NUM or a non-negative number.\n");
+        if (parse_range_list(range_arg, &ranges) < 0) {
+            fprintf(stderr, "ERROR: Invalid range format. Please use NUM-NUM, NUM, NUM- or -NUM-, separated by commas.\n");
             return 1;
         }
+    }
+    if (option_field & OPTION_BYTES) {
+        FAIL_IF_R_M(parse_byte_range(byte_range_arg, &byte_start, &byte_end) < 0, 1, stderr,
+                    "ERROR: Invalid byte range format. Please use START-END or START-.\n");
+        FAIL_IF_R_M(ranges.tail > 0, 1, stderr, "ERROR: --byte-range cannot be combined with tail ranges (-NUM-).\n");
+    }
+
+    // Counters must be running before the decoder and worker threads start
+    struct stats stats;
+    if (show_stats) {
+        stats_start(&stats);
+    }
+
+    // --- Several Files ---
+
+    if (multi) {
+        FAIL_IF_R_M((option_field & (OPTION_FOLLOW | OPTION_BYTES)) || ranges.tail > 0, 1, stderr,
+                    "ERROR: --follow, --byte-range and tail ranges (-NUM-) take a single FILE.\n");
+        FAIL_IF_R_M(strlen(search_term) >= MAX_TERM_LENGTH, 1, stderr, "ERROR: Search term is too long.\n");
+
+        FILE *file_stream = stdout;
+        if (option_field & OPTION_SAVE) {
+            file_stream = fopen(save_filepath, "w");
+            FAIL_IF_R_M(file_stream == NULL, 1, stderr, "search: Could not open save file.\n");
+        }
 
-        // Sort the range values
-        if (upperrange < lowerrange) {
-            int intholder = upperrange;
-            upperrange = lowerrange;
-            lowerrange = intholder;
+        if (recursive && file_count == 1) {
+            fprintf(stderr, "Searching for \"%s\" in every file under %s\n", search_term, file_paths[0]);
+        } else if (recursive) {
+            fprintf(stderr, "Searching for \"%s\" in every file under %zu paths\n", search_term, file_count);
+        } else {
+            fprintf(stderr, "Searching for \"%s\" in %zu files\n", search_term, file_count);
+        }
+        print_limits(threads, threads_set);
+        if (binary_mode == BINARY_SKIP) {
+            fprintf(stderr, "Skipping binary files (use --binary-files=text to search them)...\n");
+        } else if (binary_mode == BINARY_MATCHES) {
+            fprintf(stderr, "Binary files: only reporting whether they match...\n");
+        }
+        print_option_status(option_field, &ranges, 1);
+        if (option_field & OPTION_SAVE) fprintf(stderr, "Saving results to %s...\n", save_filepath);
+        fputc('\n', stderr);
+
+        struct output out;
+        FAIL_IF_R_M(output_init(&out, file_stream) < 0, 1, stderr, "search: Out of memory.\n");
+        struct search_ctx ctx = {
+            .term = search_term,
+            .term_len = strlen(search_term),
+            .options = option_field,
+            .ranges = ranges.items,
+            .range_count = ranges.count,
+            .out = &out,
+        };
+        int rc = pool_search(&ctx, file_paths, file_count, recursive, binary_mode, threads,
+                             show_stats ? &stats : NULL);
+
+        int write_failed = output_close(&out) < 0;
+        range_list_free(&ranges);
+        if (print_summary(ctx.results, save_filepath, file_stream, write_failed) < 0) {
+            rc = -1;
+        }
+        if (show_stats) {
+            stats_report(&stats, stderr);
         }
+        return rc < 0 ? 1 : 0;
     }
 
     // --- File Handling Setup ---
     
-    FILE *searchfile = fopen(search_file, "r");
-    FAIL_IF_R_M(searchfile == NULL, 1, stderr, "search: Could not open search file.\n");
+    struct reader reader;
+    if (open_search_file(&reader, search_file) < 0) {
+        return 1;
+    }
+    if ((option_field & OPTION_BYTES) && reader.frames != NULL) {
+        fprintf(stderr, "ERROR: --byte-range is not supported for block-compressed archives.\n");
+        reader_close(&reader);
+        return 1;
+    }
+    if ((option_field & OPTION_FOLLOW) && (reader.format != DECODER_NONE || !reader.mapped)) {
+        fprintf(stderr, "ERROR: --follow needs an uncompressed regular file.\n");
+        reader_close(&reader);
+        return 1;
+    }
+
+    // Binary input is recognised by a NUL byte in its first block, as grep does.
+    int binary = 0;
+    if (binary_mode != BINARY_TEXT) {
+        const char *head;
+        size_t headlen;
+        binary = reader_peek(&reader, &head, &headlen) == 0 && memscan_has_nul(head, headlen);
+    }
+
+    // A trigram index narrows an unchanged plain file down to the blocks that hold
+    // every trigram of the term; only those are searched.
+    struct trigram_index tri_idx = {0};
+    uint64_t *candidates = NULL;
+    size_t candidate_count = 0;
+    if (reader.mapped && reader.format == DECODER_NONE && !binary && ranges.tail == 0 &&
+        !(option_field & (OPTION_FOLLOW | OPTION_BYTES)) && strlen(search_term) >= TRIGRAM_MIN_TERM &&
+        strcmp(search_file, "-") != 0) {
+        struct stat st;
+        if (fstat(reader.fd, &st) == 0 && trigram_index_open(search_file, &st, &tri_idx) == 0) {
+            candidates = trigram_index_candidates(&tri_idx, search_term, strlen(search_term), &candidate_count);
+            if (candidates != NULL && candidate_count == tri_idx.block_count && candidate_count > 0) {
+                free(candidates); // Every block: the full (parallel) scan is no slower
+                candidates = NULL;
+            }
+            if (candidates == NULL) {
+                trigram_index_close(&tri_idx);
+            }
+        }
+    }
+
+    // A plain-file line index lets a range query jump close to its first line.
+    struct line_index lines_idx = {0};
+    int have_lines_idx = 0;
+    if (reader.mapped && reader.format == DECODER_NONE && (option_field & (OPTION_RANGE | OPTION_BYTES)) &&
+        candidates == NULL && strcmp(search_file, "-") != 0) {
+        struct stat st;
+        have_lines_idx = fstat(reader.fd, &st) == 0 &&
+                         line_index_load(search_file, &st, LINE_INDEX_LINES, &lines_idx) == 0;
+    }
+
+    // Tail ranges are found by scanning backward from the end, so only the tail is read.
+    uint64_t seek_offset = 0;
+    uint64_t lines_before = 0;
+    int tail_seek = 0;
+    int tail_numbered = 0;
+    if (ranges.tail > 0) {
+        if (!reader.mapped || reader.format != DECODER_NONE) {
+            fprintf(stderr, "ERROR: Tail ranges (-NUM-) need an uncompressed regular file.\n");
+            line_index_free(&lines_idx);
+            reader_close(&reader);
+            range_list_free(&ranges);
+            return 1;
+        }
+        seek_offset = memscan_tail_start(reader.block, reader.block_len, ranges.tail);
+
+        // Absolute line numbers are only needed when printed or mixed with other ranges.
+        tail_numbered = (option_field & OPTION_LINES) || ranges.count > 0;
+        if (tail_numbered) {
+            uint64_t from = 0;
+            if (have_lines_idx) {
+                line_index_offset_seek(&lines_idx, seek_offset, &from, &lines_before);
+            }
+            lines_before += memscan_count_newlines(reader.block + from, (size_t)(seek_offset - from));
+        }
+        FAIL_IF_R_M(range_list_add(&ranges, lines_before + 1, RANGE_OPEN_END) < 0, 1, stderr,
+                    "search: Out of memory.\n");
+        tail_seek = 1;
+    }
+
+    // The overall span, used to pick where reading starts and stops
+    if (option_field & OPTION_RANGE) {
+        lowerrange = ranges.items[0].low;
+        upperrange = ranges.items[ranges.count - 1].high;
+    }
 
     FILE *file_stream = stdout; // Default output stream
     if (option_field & OPTION_SAVE) {
@@ -229,76 +753,205 @@ int main(int argc, char *argv[])
         FAIL_IF_R_M(file_stream == NULL, 1, stderr, "search: Could not open save file.\n");
     }
 
+    // A block line index lets a range query start at the block holding its first line.
+    size_t first_frame = 0;
+    size_t frame_count = reader.frame_count;
+    int frames_indexed = 0;
+    if (reader.frames != NULL && (option_field & OPTION_RANGE) && strcmp(search_file, "-") != 0) {
+        struct stat st;
+        struct line_index idx;
+        if (fstat(reader.fd, &st) == 0 && line_index_load(search_file, &st, LINE_INDEX_BLOCKS, &idx) == 0) {
+            if (idx.count == reader.frame_count) {
+                line_index_block_span(&idx, lowerrange, upperrange,
+                                      &first_frame, &frame_count, &lines_before);
+                frames_indexed = 1;
+            }
+            line_index_free(&idx);
+        }
+    }
+
+    // Jump to the tail if nothing before it is wanted, else as close to the first line as indexed.
+    int lines_indexed = 0;
+    if (tail_seek && lowerrange == lines_before + 1) {
+        lines_indexed = seek_offset > 0 && reader_seek(&reader, seek_offset) == 0;
+    } else {
+        tail_seek = 0;
+    }
+    if (!tail_seek && !(option_field & OPTION_BYTES) && have_lines_idx && lowerrange > LINE_INDEX_STRIDE) {
+        line_index_line_seek(&lines_idx, lowerrange, &seek_offset, &lines_before);
+        lines_indexed = lines_before > 0 && reader_seek(&reader, seek_offset) == 0;
+    }
+
+    // A byte range starts at the first line beginning at or after its start offset.
+    int byte_status = 0;
+    if ((option_field & OPTION_BYTES) && byte_start > 0) {
+        // Line numbers are only counted when printed or filtered; the line index shortens the count.
+        int numbered = (option_field & (OPTION_LINES | OPTION_RANGE)) != 0;
+        uint64_t from = byte_start - 1;
+        uint64_t counted = 0;
+        if (numbered) {
+            from = 0;
+            if (have_lines_idx) {
+                line_index_offset_seek(&lines_idx, byte_start - 1, &from, &lines_before);
+            }
+        }
+        if (from > 0 && reader_seek(&reader, from) < 0) {
+            from = 0; // Streams are read through from the start
+            lines_before = 0;
+        }
+
+        // Pass everything up to the byte before START, then the rest of its line.
+        byte_status = reader_skip_bytes(&reader, byte_start - 1 - from, numbered ? &counted : NULL);
+        lines_before += counted;
+        if (byte_status == 0) {
+            byte_status = reader_skip_lines(&reader, 1, &counted);
+            lines_before += counted;
+        }
+    }
+    line_index_free(&lines_idx);
+
+    // Large plain files are split into line-aligned chunks and searched on every thread.
+    int parallel_chunks = reader.mapped && reader.format == DECODER_NONE && !binary && threads > 1 &&
+                          candidates == NULL &&
+                          !(option_field & (OPTION_FOLLOW | OPTION_BYTES)) &&
+                          reader.block_len - reader.pos >= 2 * (size_t)PARALLEL_CHUNK_SIZE;
+
+    // Streams are read, matched and written on separate threads.
+    int pipelined = !reader.mapped && reader.frames == NULL && !binary && threads > 1 &&
+                    !(option_field & (OPTION_FOLLOW | OPTION_BYTES));
+
     // --- Status Output ---
 
-    fprintf(stderr, "Searching for \"%s\" in %s\n", search_term, search_file);
-    if (option_field & OPTION_ISOLATE) fprintf(stderr, "Isolating matches...\n");
-    if (option_field & OPTION_IGNORE) fprintf(stderr, "Ignoring cases...\n");
-    if (option_field & OPTION_LINES) fprintf(stderr, "Including line numbers/positions...\n");
-    if (option_field & OPTION_REMOVE) fprintf(stderr, "Removing duplicate lines...\n");
-    if (option_field & OPTION_RANGE) fprintf(stderr, "Showing results in a range: %d-%d...\n", lowerrange, upperrange);
+    const char *display_name = strcmp(search_file, "-") == 0 ? "(standard input)" : search_file;
+    fprintf(stderr, "Searching for \"%s\" in %s\n", search_term, display_name);
+    print_limits(threads, threads_set);
+    if (candidates != NULL) {
+        fprintf(stderr, "Using trigram index: searching %zu of %zu blocks...\n", candidate_count,
+                tri_idx.block_count);
+    } else if (frames_indexed) {
+        fprintf(stderr, "Using line index: decompressing %s blocks %zu-%zu of %zu on %u threads...\n",
+                decoder_name(reader.format), first_frame + 1, first_frame + frame_count,
+                reader.frame_count, threads);
+    } else if (lines_indexed && tail_seek) {
+        fprintf(stderr, "Scanned backward from the end: starting at byte %llu...\n",
+                (unsigned long long)seek_offset);
+    } else if (lines_indexed) {
+        fprintf(stderr, "Using line index: starting at line %llu (byte %llu)...\n",
+                (unsigned long long)lines_before + 1, (unsigned long long)seek_offset);
+    } else if (reader.frames != NULL) {
+        fprintf(stderr, "Decompressing %zu %s frames on %u threads...\n", reader.frame_count,
+                decoder_name(reader.format), threads);
+    } else if (reader.format != DECODER_NONE) {
+        fprintf(stderr, "Decompressing %s input...\n", decoder_name(reader.format));
+    }
+    if (parallel_chunks) {
+        fprintf(stderr, "Searching in %d MiB chunks on %u threads...\n", PARALLEL_CHUNK_SIZE >> 20, threads);
+    } else if (pipelined) {
+        fprintf(stderr, "Pipelining: reader thread, %u matcher threads, writer...\n", threads - 1);
+    }
+    if (binary && binary_mode == BINARY_SKIP) {
+        fprintf(stderr, "Skipping binary file %s (use --binary-files=text to search it)...\n", display_name);
+    } else if (binary) {
+        fprintf(stderr, "Binary file: only reporting whether it matches...\n");
+    }
+    print_option_status(option_field, &ranges, tail_numbered);
+    if (option_field & OPTION_BYTES) {
+        if (byte_end == UINT64_MAX) {
+            fprintf(stderr, "Showing lines that begin from byte %llu on...\n", (unsigned long long)byte_start);
+        } else {
+            fprintf(stderr, "Showing lines that begin in bytes %llu-%llu...\n",
+                    (unsigned long long)byte_start, (unsigned long long)byte_end);
+        }
+    }
     if (option_field & OPTION_SAVE) fprintf(stderr, "Saving results to %s...\n", save_filepath);
+    if (option_field & OPTION_FOLLOW) fprintf(stderr, "Following %s for appended lines (Ctrl-C to stop)...\n", display_name);
     fputc('\n', stderr);
 
     // --- Core Search Loop ---
 
-    char linebuff[MAX_LINE_LENGTH];
-    int linecount = 1;
-    unsigned int resultstracker = 0;
+    uint64_t linecount = 1;
+    int readstatus = 0;
+    int follow = (option_field & OPTION_FOLLOW) && !(binary && binary_mode == BINARY_SKIP);
+    uint64_t follow_offset = 0;
+
+    struct output out;
+    FAIL_IF_R_M(output_init(&out, file_stream) < 0, 1, stderr, "search: Out of memory.\n");
 
     // Check if search term is too long
     FAIL_IF_R_M(strlen(search_term) >= MAX_TERM_LENGTH, 1, stderr, "ERROR: Search term is too long.\n");
 
-    while (fgets(linebuff, MAX_LINE_LENGTH, searchfile)) {
-        
-        // 1. Range check
-        if ((option_field & OPTION_RANGE) && (linecount < lowerrange || linecount > upperrange)) {
-            linecount++;
-            continue;
-        }
+    struct search_ctx ctx = {
+        .term = search_term,
+        .term_len = strlen(search_term),
+        .options = option_field,
+        .ranges = ranges.items,
+        .range_count = ranges.count,
+        .out = &out,
+        .name = display_name,
+        .binary = binary,
+    };
 
-        // 2. Search for all matches in the current line
-        int matches_on_line = 0;
-        char *search_start = linebuff;
-        
-        // Loop while matches are found, starting the next search after the last match
-        while ((search_start = search_line(search_start, search_term, option_field)) != NULL) {
-            
-            // Match found!
-            matches_on_line++;
-            
-            // 3. Print the prefix (Line number/Position) if required
-            if (option_field & OPTION_LINES) {
-                // Calculate position based on the start of the line
-                int position = (int)(search_start - linebuff) + 1;
-                fprintf(file_stream, "LINE %d, POS %d: ", linecount, position);
+    if (binary && binary_mode == BINARY_SKIP) {
+        // Nothing to search.
+    } else if (reader.frames != NULL) {
+        // Inputs made of independent compressed frames are decoded and searched in parallel.
+        readstatus = parallel_search_frames(&ctx, reader.format, reader.frames + first_frame, frame_count,
+                                            lines_before, threads);
+    } else {
+        // Lines outside the ranges are skipped in bulk, and reading stops after the last one.
+        if (lines_indexed || (option_field & OPTION_BYTES)) {
+            linecount += lines_before;
+        }
+        readstatus = byte_status;
+        if (readstatus < 0) {
+            // The byte range could not be reached.
+        } else if (candidates != NULL) {
+            readstatus = scan_indexed(&ctx, reader.map, reader.map_len, &tri_idx, candidates);
+        } else if (parallel_chunks) {
+            readstatus = parallel_search_mapped(&ctx, reader.block + reader.pos, reader.block_len - reader.pos,
+                                                linecount - 1, threads);
+        } else if (pipelined) {
+            // The gap before the first range is only counted, as in scan_lines.
+            uint64_t nextline = search_next_in_range(&ctx, linecount);
+            if (nextline > linecount) {
+                uint64_t skipped;
+                readstatus = reader_skip_lines(&reader, nextline - linecount, &skipped);
+                linecount += skipped;
             }
-
-            // 4. Print the line content
-            fprintf(file_stream, "%s", linebuff);
-            resultstracker++;
-            
-            // 5. Handle OPTION_REMOVE: if we show the line once, break the inner search loop
-            if (option_field & OPTION_REMOVE) {
-                break;
+            if (nextline != 0 && readstatus >= 0) {
+                readstatus = pipeline_search(&ctx, &reader, linecount - 1, threads - 1);
             }
-
-            // Move search_start past the found term to look for the next match on the same line
-            search_start += strlen(search_term);
+        } else {
+            readstatus = scan_lines(&ctx, &reader, &linecount, byte_end, follow, &follow_offset);
         }
+    }
 
-        linecount++;
+    // Then wait for appended lines, unless no later line could be printed
+    if (follow && readstatus >= 0 && !ctx.done && !search_past_range(&ctx, linecount) &&
+        follow_offset < byte_end) {
+        output_flush(&out);
+        // The descriptor that was searched, so a rotation since then is still noticed.
+        int follow_fd = dup(reader.fd);
+        readstatus = follow_fd < 0 ? -1
+                                   : follow_file(&ctx, search_file, follow_fd, follow_offset, linecount, byte_end);
     }
 
     // --- Cleanup and Summary ---
 
-    fclose(searchfile);
-    if (option_field & OPTION_SAVE) {
-        fprintf(stderr, "\n%u results written to %s.\n", resultstracker, save_filepath);
-        fclose(file_stream);
-    } else {
-        fprintf(stderr, "\n%u results written to stdout.\n", resultstracker);
+    if (readstatus < 0) {
+        fprintf(stderr, "search: Error while reading search file.\n");
+    }
+    int write_failed = output_close(&out) < 0;
+    free(candidates);
+    trigram_index_close(&tri_idx);
+    reader_close(&reader);
+    range_list_free(&ranges);
+    if (print_summary(ctx.results, save_filepath, file_stream, write_failed) < 0) {
+        readstatus = -1;
+    }
+    if (show_stats) {
+        stats_report(&stats, stderr);
     }
 
-    return 0;
+    return readstatus < 0 ? 1 : 0;
 }
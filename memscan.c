@@ -0,0 +1,151 @@
+/**
+ * @file memscan.c
+ * @brief Implementation of the vectorised block scans.
+ */
+
+#include "memscan.h"
+
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef __SSE2__
+/**
+ * @brief Returns one bit per newline in the 64 bytes at p (bit 0 is p[0]).
+ */
+static inline uint64_t newline_mask64(const char *p)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    uint64_t a = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), newline));
+    uint64_t b = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 16)), newline));
+    uint64_t c = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 32)), newline));
+    uint64_t d = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 48)), newline));
+    return a | b << 16 | c << 32 | d << 48;
+}
+#endif
+
+int memscan_has_nul(const char *data, size_t len)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+
+    // Four vectors per iteration, OR-ed together so there is one branch per 64 bytes.
+    for (; i + 64 <= len; i += 64) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), zero);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 16)), zero);
+        __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 32)), zero);
+        __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 48)), zero);
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))) != 0) {
+            return 1;
+        }
+    }
+#endif
+
+    return memchr(data + i, '\0', len - i) != NULL;
+}
+
+size_t memscan_skip_lines(const char *data, size_t len, uint64_t *lines)
+{
+    size_t i = 0;
+    uint64_t left = *lines;
+
+    if (left == 0) {
+        return 0;
+    }
+
+#ifdef __SSE2__
+    // One bit per newline in each 64-byte stretch, counted with popcount.
+    for (; i + 64 <= len; i += 64) {
+        uint64_t mask = newline_mask64(data + i);
+        uint64_t found = (uint64_t)__builtin_popcountll(mask);
+
+        if (found < left) {
+            left -= found;
+            continue;
+        }
+
+        // The last line to skip ends in this stretch: find its newline.
+        while (--left > 0) {
+            mask &= mask - 1;
+        }
+        *lines = 0;
+        return i + (size_t)__builtin_ctzll(mask) + 1;
+    }
+#endif
+
+    while (i < len) {
+        const char *nl = memchr(data + i, '\n', len - i);
+        if (nl == NULL) {
+            break;
+        }
+        i = (size_t)(nl - data) + 1;
+        if (--left == 0) {
+            *lines = 0;
+            return i;
+        }
+    }
+
+    *lines = left;
+    return len;
+}
+
+uint64_t memscan_count_newlines(const char *data, size_t len)
+{
+    uint64_t count = 0;
+    size_t i = 0;
+
+#ifdef __SSE2__
+    for (; i + 64 <= len; i += 64) {
+        count += (uint64_t)__builtin_popcountll(newline_mask64(data + i));
+    }
+#endif
+
+    for (; i < len; i++) {
+        count += data[i] == '\n';
+    }
+    return count;
+}
+
+size_t memscan_tail_start(const char *data, size_t len, uint64_t lines)
+{
+    size_t i = len;
+
+    if (lines == 0) {
+        return len;
+    }
+
+    // The newline ending the last line does not start a new one.
+    if (i > 0 && data[i - 1] == '\n') {
+        i--;
+    }
+
+#ifdef __SSE2__
+    // Walk backward 64 bytes at a time until the newline before the tail is in sight.
+    for (; i >= 64; i -= 64) {
+        uint64_t mask = newline_mask64(data + i - 64);
+        uint64_t found = (uint64_t)__builtin_popcountll(mask);
+
+        if (found < lines) {
+            lines -= found;
+            continue;
+        }
+
+        // Drop the newlines nearest the end until the one before the tail is on top.
+        while (--lines > 0) {
+            mask &= ~(1ULL << (63 - __builtin_clzll(mask)));
+        }
+        return i - 64 + (size_t)(63 - __builtin_clzll(mask)) + 1;
+    }
+#endif
+
+    while (i > 0) {
+        i--;
+        if (data[i] == '\n' && --lines == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+/**
+ * @file memscan.h
+ * @brief Vectorised scans over raw input blocks.
+ *
+ * These run over whole blocks rather than lines, 16 bytes at a time with
+ * SSE2 where available (every x86-64 CPU), with a portable fallback.
+ */
+#ifndef MEMSCAN_H
+#define MEMSCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Checks a block for NUL bytes, the usual sign of binary data.
+ *
+ * @param data The block to scan.
+ * @param len The block length.
+ * @return 1 if the block contains a NUL byte, 0 otherwise.
+ */
+int memscan_has_nul(const char *data, size_t len);
+
+/**
+ * @brief Skips whole lines in a block by counting newlines in bulk.
+ *
+ * @param data The block to scan.
+ * @param len The block length.
+ * @param lines The number of lines to skip; decremented by the newlines passed.
+ * @return The offset just past the last newline skipped, or len if the block
+ * ran out first (the partial line at its end then belongs to a skipped line).
+ */
+size_t memscan_skip_lines(const char *data, size_t len, uint64_t *lines);
+
+/**
+ * @brief Counts the newlines in a block.
+ */
+uint64_t memscan_count_newlines(const char *data, size_t len);
+
+/**
+ * @brief Finds where the last lines of a block begin, scanning backward from
+ * its end so that only the tail is read.
+ *
+ * A final line without a trailing newline counts as a line.
+ *
+ * @param data The block to scan.
+ * @param len The block length.
+ * @param lines The number of lines wanted from the end.
+ * @return The offset of the first of those lines (0 if the block has fewer).
+ */
+size_t memscan_tail_start(const char *data, size_t len, uint64_t lines);
+
+#endif // MEMSCAN_H
@@ -0,0 +1,179 @@
+/**
+ * @file numa.c
+ * @brief Implementation of NUMA placement.
+ */
+
+#define _GNU_SOURCE
+#include "numa.h"
+
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct numa_node {
+    unsigned id;                // System node number
+    cpu_set_t cpus;             // Its CPUs that this process may use
+};
+
+static struct numa_node nodes[NUMA_MAX_NODES];
+static unsigned node_count;
+static pthread_once_t nodes_once = PTHREAD_ONCE_INIT;
+#define NUMA_CACHE_LINE 64
+
+// Totals per node, each on its own cache line; a worker adds its counts once, when it is done.
+static struct numa_total {
+    struct numa_usage usage;
+} __attribute__((aligned(NUMA_CACHE_LINE))) node_usage[NUMA_MAX_NODES];
+
+static __thread int thread_node = -1;          // Node the calling thread is pinned to
+static __thread struct numa_usage thread_usage; // What the calling thread scanned since numa_pin
+
+/**
+ * @brief Parses a sysfs list such as "0-3,8,10-11", calling add for every number.
+ */
+static void numa_parse_list(const char *list, void (*add)(unsigned value, void *arg), void *arg)
+{
+    const char *p = list;
+    while (*p != '\0' && *p != '\n') {
+        char *end;
+        unsigned long low = strtoul(p, &end, 10);
+        if (end == p) {
+            return;
+        }
+        unsigned long high = low;
+        if (*end == '-') {
+            p = end + 1;
+            high = strtoul(p, &end, 10);
+            if (end == p) {
+                return;
+            }
+        }
+        for (unsigned long v = low; v <= high && v < CPU_SETSIZE; v++) {
+            add((unsigned)v, arg);
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+}
+
+/**
+ * @brief Reads a one-line sysfs file.
+ * @return 0 on success, -1 if it cannot be read.
+ */
+static int numa_read(const char *path, char *buf, size_t size)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    int ok = fgets(buf, (int)size, f) != NULL;
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+static void numa_add_cpu(unsigned cpu, void *arg)
+{
+    CPU_SET(cpu, (cpu_set_t *)arg);
+}
+
+static void numa_add_node(unsigned id, void *arg)
+{
+    const cpu_set_t *allowed = arg;
+    char path[128];
+    char list[4096];
+    if (node_count == NUMA_MAX_NODES || id >= NUMA_MAX_NODES) {
+        return;
+    }
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", id);
+    if (numa_read(path, list, sizeof(list)) < 0) {
+        return;
+    }
+
+    // Only the CPUs in the affinity mask count; a node without any is left out.
+    struct numa_node *n = &nodes[node_count];
+    CPU_ZERO(&n->cpus);
+    numa_parse_list(list, numa_add_cpu, &n->cpus);
+    CPU_AND(&n->cpus, &n->cpus, allowed);
+    if (CPU_COUNT(&n->cpus) > 0) {
+        n->id = id;
+        node_count++;
+    }
+}
+
+static void numa_detect(void)
+{
+    cpu_set_t allowed;
+    char list[4096];
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0 &&
+        numa_read("/sys/devices/system/node/online", list, sizeof(list)) == 0) {
+        numa_parse_list(list, numa_add_node, &allowed);
+    }
+    if (node_count == 0) {
+        node_count = 1; // No topology: one node, never pinned
+        nodes[0].id = 0;
+        CPU_ZERO(&nodes[0].cpus);
+    }
+}
+
+unsigned numa_node_count(void)
+{
+    pthread_once(&nodes_once, numa_detect);
+    return node_count;
+}
+
+unsigned numa_node_id(unsigned node)
+{
+    pthread_once(&nodes_once, numa_detect);
+    return nodes[node % node_count].id;
+}
+
+void numa_pin(unsigned node)
+{
+    pthread_once(&nodes_once, numa_detect);
+    node %= node_count;
+    if (node_count > 1) {
+        sched_setaffinity(0, sizeof(nodes[node].cpus), &nodes[node].cpus);
+    }
+    thread_node = (int)node;
+    thread_usage.bytes = 0;
+    thread_usage.busy_ns = 0;
+}
+
+void numa_bind_local(void *buf, size_t len)
+{
+    if (thread_node < 0 || node_count < 2) {
+        return;
+    }
+
+    // Preferred rather than strict: a full node falls back to another instead of failing.
+    unsigned id = nodes[thread_node].id;
+    unsigned long mask[NUMA_MAX_NODES / (8 * sizeof(unsigned long)) + 1];
+    memset(mask, 0, sizeof(mask));
+    mask[id / (8 * sizeof(unsigned long))] |= 1UL << (id % (8 * sizeof(unsigned long)));
+    syscall(SYS_mbind, buf, len, MPOL_PREFERRED, mask, (unsigned long)(8 * sizeof(mask)), 0);
+}
+
+void numa_account(uint64_t bytes, uint64_t busy_ns)
+{
+    thread_usage.bytes += bytes;
+    thread_usage.busy_ns += busy_ns;
+}
+
+void numa_unpin(void)
+{
+    unsigned node = thread_node >= 0 ? (unsigned)thread_node : 0;
+    __atomic_add_fetch(&node_usage[node].usage.bytes, thread_usage.bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&node_usage[node].usage.busy_ns, thread_usage.busy_ns, __ATOMIC_RELAXED);
+    thread_usage.bytes = 0;
+    thread_usage.busy_ns = 0;
+}
+
+void numa_usage(unsigned node, struct numa_usage *usage)
+{
+    usage->bytes = __atomic_load_n(&node_usage[node].usage.bytes, __ATOMIC_RELAXED);
+    usage->busy_ns = __atomic_load_n(&node_usage[node].usage.busy_ns, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,66 @@
+/**
+ * @file numa.h
+ * @brief NUMA node topology, worker placement and per-node scan accounting.
+ *
+ * The nodes are read from sysfs and limited to the CPUs this process may run
+ * on. A worker pinned to a node runs on that node's CPUs only, and the scan
+ * buffers it allocates are bound to the node with mbind(2), so a chunk is
+ * read into and scanned from local memory. On a single-node machine nothing
+ * is pinned or bound. No libnuma is needed.
+ */
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NUMA_MAX_NODES 64
+
+/**
+ * @brief What the workers on one node scanned.
+ */
+struct numa_usage {
+    uint64_t bytes;             // Input bytes scanned
+    uint64_t busy_ns;           // Time spent scanning them
+};
+
+/**
+ * @brief Returns the number of nodes with CPUs this process may use (at least 1).
+ */
+unsigned numa_node_count(void);
+
+/**
+ * @brief Returns the system number of a node (0 .. numa_node_count() - 1).
+ */
+unsigned numa_node_id(unsigned node);
+
+/**
+ * @brief Pins the calling thread to a node's CPUs; later scan buffers it
+ * allocates are bound to that node.
+ *
+ * @param node The node (0 .. numa_node_count() - 1).
+ */
+void numa_pin(unsigned node);
+
+/**
+ * @brief Binds fresh (untouched) memory to the calling thread's node, if it is pinned.
+ */
+void numa_bind_local(void *buf, size_t len);
+
+/**
+ * @brief Adds scanned bytes and time to the calling thread's own counters.
+ */
+void numa_account(uint64_t bytes, uint64_t busy_ns);
+
+/**
+ * @brief Adds the calling thread's counters to its node's totals. Call once
+ * the thread is done scanning, before it exits.
+ */
+void numa_unpin(void);
+
+/**
+ * @brief Reads what the workers on a node scanned, up to their numa_unpin.
+ */
+void numa_usage(unsigned node, struct numa_usage *usage);
+
+#endif // NUMA_H
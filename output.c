@@ -0,0 +1,280 @@
+/**
+ * @file output.c
+ * @brief Implementation of the batched result output.
+ */
+
+#define _GNU_SOURCE
+#include "output.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int output_init(struct output *out, FILE *stream)
+{
+    struct stat st;
+
+    out->stream = stream;
+    out->fd = fileno(stream);
+    out->splice = (fstat(out->fd, &st) == 0 && S_ISFIFO(st.st_mode));
+    out->interactive = isatty(out->fd);
+    out->error = 0;
+    out->buf = malloc(OUTPUT_BUFFER_SIZE);
+    out->buf_len = 0;
+    out->iov_count = 0;
+    out->mem = NULL;
+    out->mem_len = 0;
+    out->mem_cap = 0;
+    return out->buf != NULL ? 0 : -1;
+}
+
+int output_init_memory(struct output *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->fd = -1;
+    out->buf = malloc(OUTPUT_BUFFER_SIZE);
+    return out->buf != NULL ? 0 : -1;
+}
+
+/**
+ * @brief Appends a run of iovecs to a memory sink.
+ */
+static int output_append(struct output *out, const struct iovec *iov, int count)
+{
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        total += iov[i].iov_len;
+    }
+    if (out->mem_len + total > out->mem_cap) {
+        size_t cap = out->mem_cap ? out->mem_cap : OUTPUT_BUFFER_SIZE;
+        while (cap < out->mem_len + total) {
+            cap *= 2;
+        }
+        char *grown = realloc(out->mem, cap);
+        if (grown == NULL) {
+            return -1;
+        }
+        out->mem = grown;
+        out->mem_cap = cap;
+    }
+    for (int i = 0; i < count; i++) {
+        memcpy(out->mem + out->mem_len, iov[i].iov_base, iov[i].iov_len);
+        out->mem_len += iov[i].iov_len;
+    }
+    return 0;
+}
+
+/**
+ * @brief Advances an iovec array past `done` bytes that were already written.
+ * @return The index of the first iovec with bytes left.
+ */
+static int iov_advance(struct iovec *iov, int count, size_t done)
+{
+    int i = 0;
+    while (i < count && done >= iov[i].iov_len) {
+        done -= iov[i].iov_len;
+        i++;
+    }
+    if (i < count) {
+        iov[i].iov_base = (char *)iov[i].iov_base + done;
+        iov[i].iov_len -= done;
+    }
+    return i;
+}
+
+/**
+ * @brief Checks whether a span starts in the output buffer.
+ */
+static int output_buffered(const struct output *out, const char *data)
+{
+    return data >= out->buf && data < out->buf + OUTPUT_BUFFER_SIZE;
+}
+
+/**
+ * @brief Writes a run of iovecs completely, by vmsplice(2) if asked and
+ * possible, else by writev(2).
+ */
+static int output_write_run(struct output *out, struct iovec *iov, int count, int splice)
+{
+    if (out->fd < 0) {
+        return output_append(out, iov, count);
+    }
+    while (count > 0) {
+        ssize_t n = (splice && out->splice) ? vmsplice(out->fd, iov, (unsigned long)count, 0)
+                                            : writev(out->fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (splice && out->splice && (errno == EINVAL || errno == ENOSYS || errno == EBADF)) {
+                out->splice = 0; // Not a splice-capable pipe after all
+                continue;
+            }
+            return -1;
+        }
+        int first = iov_advance(iov, count, (size_t)n);
+        iov += first;
+        count -= first;
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes out every queued span and empties the buffer.
+ *
+ * Buffered bytes are reused after the flush, so a pipe may only be handed
+ * the stable spans by reference; the buffered runs between them are copied.
+ */
+static int output_flush_iov(struct output *out)
+{
+    int rc = 0;
+
+    if (out->error) {
+        rc = -1; // The destination already failed; the rest is dropped
+    } else if (!out->splice) {
+        rc = output_write_run(out, out->iov, out->iov_count, 0);
+    } else {
+        int start = 0;
+        while (rc == 0 && start < out->iov_count) {
+            int buffered = output_buffered(out, out->iov[start].iov_base);
+            int end = start + 1;
+            while (end < out->iov_count && output_buffered(out, out->iov[end].iov_base) == buffered) {
+                end++;
+            }
+            rc = output_write_run(out, out->iov + start, end - start, !buffered);
+            start = end;
+        }
+    }
+
+    out->iov_count = 0;
+    out->buf_len = 0;
+    if (rc < 0) {
+        out->error = 1;
+    }
+    return rc;
+}
+
+/**
+ * @brief Queues a span, merging it into the previous iovec when contiguous
+ * (and of the same kind, buffered or referenced).
+ */
+static int output_queue(struct output *out, const char *data, size_t len)
+{
+    if (out->iov_count > 0) {
+        struct iovec *last = &out->iov[out->iov_count - 1];
+        if ((const char *)last->iov_base + last->iov_len == data &&
+            output_buffered(out, last->iov_base) == output_buffered(out, data)) {
+            last->iov_len += len;
+            return 0;
+        }
+    }
+
+    out->iov[out->iov_count].iov_base = (void *)data;
+    out->iov[out->iov_count].iov_len = len;
+    if (++out->iov_count == OUTPUT_IOV_MAX) {
+        return output_flush_iov(out);
+    }
+    return 0;
+}
+
+char *output_reserve(struct output *out, size_t len)
+{
+    if (out->error) {
+        return NULL;
+    }
+    if (OUTPUT_BUFFER_SIZE - out->buf_len < len && output_flush_iov(out) < 0) {
+        return NULL;
+    }
+    return out->buf + out->buf_len;
+}
+
+int output_commit(struct output *out, size_t len)
+{
+    const char *data = out->buf + out->buf_len;
+    if (out->error) {
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    out->buf_len += len;
+    return output_queue(out, data, len);
+}
+
+size_t output_format_u64(char *dst, uint64_t value)
+{
+    char digits[OUTPUT_U64_MAX_DIGITS];
+    size_t n = 0;
+
+    // Digits come out lowest first; reverse them into place.
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = digits[n - 1 - i];
+    }
+    return n;
+}
+
+int output_write(struct output *out, const char *data, size_t len, int stable)
+{
+    if (out->error) {
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    // Stable spans are referenced where they are (writev copies them straight from
+    // the mapping); only short, isolated ones are copied for a pipe, where vmsplice
+    // has to pin a page per span. Everything else is copied.
+    if (stable) {
+        const struct iovec *last = out->iov_count ? &out->iov[out->iov_count - 1] : NULL;
+        int extends = last != NULL && (const char *)last->iov_base + last->iov_len == data;
+        if (!out->splice || len >= OUTPUT_COPY_MAX || extends) {
+            return output_queue(out, data, len);
+        }
+    }
+
+    if (len > OUTPUT_BUFFER_SIZE) {
+        // Too big to gather: write it out on its own, after what is queued.
+        struct iovec iov = { .iov_base = (void *)data, .iov_len = len };
+        if (output_flush_iov(out) < 0) {
+            return -1;
+        }
+        if (output_write_run(out, &iov, 1, 0) < 0) {
+            out->error = 1;
+            return -1;
+        }
+        return 0;
+    }
+
+    char *dst = output_reserve(out, len);
+    if (dst == NULL) {
+        return -1;
+    }
+    memcpy(dst, data, len);
+    return output_commit(out, len);
+}
+
+int output_flush(struct output *out)
+{
+    if (out->iov_count && output_flush_iov(out) < 0) {
+        return -1;
+    }
+    return out->error ? -1 : 0;
+}
+
+int output_close(struct output *out)
+{
+    int rc = output_flush(out);
+    free(out->buf);
+    free(out->mem);
+    out->buf = NULL;
+    out->mem = NULL;
+    return rc;
+}
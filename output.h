@@ -0,0 +1,114 @@
+/**
+ * @file output.h
+ * @brief Batched result output with zero-copy pipe support.
+ *
+ * Results are gathered as an iovec list and written with a few large
+ * writev(2) calls instead of going through stdio. Short-lived bytes (prefixes,
+ * lines from recycled read or decode blocks) are copied into an output
+ * buffer; spans that stay valid for the rest of the run (a mapped input file)
+ * are referenced in place, and neighbouring lines merge into one iovec, so
+ * matching lines are never copied in user space. When the destination is a
+ * pipe, runs of such spans are handed over with vmsplice(2), so the kernel
+ * references the page cache instead of copying.
+ *
+ * A terminal is written to after every result, like a line-buffered stdio
+ * stream, so a live stream is seen as it is searched.
+ *
+ * A memory sink gathers the same output in a growing buffer instead, so that
+ * a worker can produce a file's results before it is that file's turn to print.
+ */
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#define OUTPUT_IOV_MAX 1024             // Spans gathered per flush (the kernel's UIO_MAXIOV)
+#define OUTPUT_BUFFER_SIZE (256 * 1024) // Bytes of copied output gathered per flush
+#define OUTPUT_COPY_MAX 256             // Stable spans shorter than this are copied for a pipe
+#define OUTPUT_U64_MAX_DIGITS 20        // Digits in the largest 64-bit value
+
+struct output {
+    FILE *stream;               // Destination stream (only its descriptor is written)
+    int fd;                     // Descriptor behind stream, or -1 for a memory sink
+    int splice;                 // Destination is a pipe; stable spans may be vmspliced
+    int interactive;            // Destination is a terminal; each result is flushed as it is printed
+    int error;                  // A write failed; everything after it is dropped
+    char *buf;                  // Copied bytes referenced by iov
+    size_t buf_len;
+    struct iovec iov[OUTPUT_IOV_MAX];
+    int iov_count;
+    char *mem;                  // Memory sink: everything flushed so far
+    size_t mem_len;
+    size_t mem_cap;
+};
+
+/**
+ * @brief Prepares an output sink for a stream.
+ * @return 0 on success, -1 if out of memory.
+ */
+int output_init(struct output *out, FILE *stream);
+
+/**
+ * @brief Prepares an output sink that collects the output in memory.
+ *
+ * After output_flush, the collected bytes are out->mem[0, out->mem_len);
+ * output_close releases them.
+ *
+ * @return 0 on success, -1 if out of memory.
+ */
+int output_init_memory(struct output *out);
+
+/**
+ * @brief Writes a span of bytes to the output.
+ *
+ * @param out The output sink.
+ * @param data The bytes to write.
+ * @param len The number of bytes.
+ * @param stable Non-zero if data stays valid and unmodified until output_flush.
+ * @return 0 on success, -1 on write error.
+ */
+int output_write(struct output *out, const char *data, size_t len, int stable);
+
+/**
+ * @brief Reserves room in the output buffer to format bytes in place.
+ *
+ * @param out The output sink.
+ * @param len The most bytes that will be written (at most OUTPUT_BUFFER_SIZE).
+ * @return Where to write them, or NULL on write error. Finish with output_commit.
+ */
+char *output_reserve(struct output *out, size_t len);
+
+/**
+ * @brief Queues the bytes written after output_reserve.
+ *
+ * @param out The output sink.
+ * @param len The number of bytes actually written.
+ * @return 0 on success, -1 on write error.
+ */
+int output_commit(struct output *out, size_t len);
+
+/**
+ * @brief Formats an unsigned integer in decimal (no terminator).
+ *
+ * @param dst Room for at least OUTPUT_U64_MAX_DIGITS bytes.
+ * @param value The value.
+ * @return The number of bytes written.
+ */
+size_t output_format_u64(char *dst, uint64_t value);
+
+/**
+ * @brief Pushes all queued spans and buffered bytes to the destination.
+ * @return 0 on success, -1 if this or an earlier write failed.
+ */
+int output_flush(struct output *out);
+
+/**
+ * @brief Flushes the output and releases its buffer.
+ * @return 0 on success, -1 if any write to the output failed.
+ */
+int output_close(struct output *out);
+
+#endif // OUTPUT_H
@@ -0,0 +1,543 @@
+/**
+ * @file parallel.c
+ * @brief Implementation of the parallel chunk scanner.
+ */
+
+#define _GNU_SOURCE
+#include "parallel.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cgroup.h"
+#include "memscan.h"
+#include "numa.h"
+#include "stats.h"
+
+/**
+ * @brief A chunk slot: the bytes of one chunk and what a worker found in it.
+ */
+struct chunk {
+    char *owned;                // Buffer to free once printed (NULL if borrowed)
+    const char *data;
+    size_t len;
+    size_t head_len;            // Bytes up to and including the first newline
+    size_t tail_off;            // Offset just past the last newline
+    size_t newlines;            // Newlines in the chunk
+    struct match_list matches;  // Matches in [head_len, tail_off)
+    int error;
+    int done;
+};
+
+struct parallel_run {
+    const struct search_ctx *ctx;
+
+    // Chunk source: load() fills c->data/len (and c->owned) for chunk `index`.
+    int (*load)(struct parallel_run *run, size_t index, struct chunk *c);
+    size_t count;
+    int stable;                 // Chunk data stays valid for the whole run
+    enum decoder_format format;
+    const struct frame *frames;
+    uint64_t lines_before;      // Newlines before the first chunk
+    int skip_head;              // The run starts mid-line; drop that line
+    uint64_t *newlines_out;     // Optional per-chunk newline counts
+    int count_only;             // Workers only count newlines (with newlines_out)
+
+    // Mapped input: chunk i covers the lines that begin in [i * S, (i + 1) * S)
+    // for S = PARALLEL_CHUNK_SIZE, so chunks start and end on line boundaries.
+    const char *map;
+    size_t map_len;
+    const size_t *chunk_ids;    // Chunks to search, if not all of them
+    const uint64_t *chunk_lines; // Newlines before each chunk in chunk_ids
+
+    struct chunk *slots;        // Ring of `window` slots; chunk i uses slot i % window
+    size_t window;
+    unsigned nodes;             // NUMA nodes the chunks are dealt to
+    size_t next[NUMA_MAX_NODES]; // Next chunk of each node: chunk i belongs to node i % nodes
+    size_t emitted;             // Chunks printed so far
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static struct parallel_limits limits;
+static pthread_once_t limits_once = PTHREAD_ONCE_INIT;
+
+static void parallel_detect_limits(void)
+{
+    // The affinity mask (taskset, cpusets) can allow fewer CPUs than are online.
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0) {
+        limits.affinity_cpus = (unsigned)CPU_COUNT(&set);
+    } else {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        limits.affinity_cpus = n > 0 ? (unsigned)n : 1;
+    }
+
+    struct cgroup_limits cg;
+    cgroup_read_limits(&cg);
+    limits.cgroup_cpus = cg.cpus;
+    limits.cgroup_memory = cg.memory;
+
+    // A fractional quota still gets a thread for the part of a CPU it allows.
+    limits.threads = limits.affinity_cpus;
+    if (cg.cpus > 0) {
+        unsigned quota = (unsigned)cg.cpus;
+        if ((double)quota < cg.cpus || quota == 0) {
+            quota++;
+        }
+        if (quota < limits.threads) {
+            limits.threads = quota;
+        }
+    }
+    if (limits.threads > PARALLEL_MAX_THREADS) {
+        limits.threads = PARALLEL_MAX_THREADS;
+    }
+    limits.buffer_budget = cg.memory > 0 ? cg.memory / PARALLEL_MEMORY_SHARE : UINT64_MAX;
+}
+
+const struct parallel_limits *parallel_limits(void)
+{
+    pthread_once(&limits_once, parallel_detect_limits);
+    return &limits;
+}
+
+unsigned parallel_default_threads(void)
+{
+    return parallel_limits()->threads;
+}
+
+size_t parallel_budget_buffers(size_t size, size_t min, size_t max)
+{
+    uint64_t fit = parallel_limits()->buffer_budget / size;
+    if (fit > max) {
+        fit = max;
+    }
+    return fit > min ? (size_t)fit : min;
+}
+
+/**
+ * @brief Chunk source for compressed frames: decodes frame `index`.
+ */
+static int load_frame(struct parallel_run *run, size_t index, struct chunk *c)
+{
+    if (decoder_decode_frame(run->format, &run->frames[index], &c->owned, &c->len) < 0) {
+        return -1;
+    }
+    c->data = c->owned;
+    return 0;
+}
+
+/**
+ * @brief Finds where mapped chunk `chunk` starts: just past the first newline
+ * at or after its nominal start, so that every chunk begins on a line.
+ */
+static size_t mapped_boundary(const struct parallel_run *run, size_t chunk)
+{
+    return parallel_chunk_start(run->map, run->map_len, chunk);
+}
+
+size_t parallel_chunk_start(const char *data, size_t len, size_t chunk)
+{
+    size_t nominal = chunk * PARALLEL_CHUNK_SIZE;
+    if (chunk == 0) {
+        return 0;
+    }
+    if (nominal >= len) {
+        return len;
+    }
+    const char *nl = memchr(data + nominal - 1, '\n', len - (nominal - 1));
+    return nl != NULL ? (size_t)(nl - data) + 1 : len;
+}
+
+/**
+ * @brief Chunk source for a mapped file: the lines of chunk `index` (in place).
+ */
+static int load_mapped(struct parallel_run *run, size_t index, struct chunk *c)
+{
+    size_t chunk = run->chunk_ids != NULL ? run->chunk_ids[index] : index;
+    size_t start = mapped_boundary(run, chunk);
+    c->data = run->map + start;
+    c->len = mapped_boundary(run, chunk + 1) - start;
+    return 0;
+}
+
+/**
+ * @brief Loads and searches one chunk (runs on a worker thread).
+ */
+static void scan_chunk(struct parallel_run *run, size_t index, struct chunk *c)
+{
+    if (run->load(run, index, c) < 0) {
+        c->error = 1;
+        return;
+    }
+    if (run->count_only) {
+        c->newlines = memscan_count_newlines(c->data, c->len);
+        return;
+    }
+
+    const char *first = c->len ? memchr(c->data, '\n', c->len) : NULL;
+    if (first == NULL) {
+        return; // Entirely inside one line; the merger stitches it
+    }
+    const char *last = memrchr(c->data, '\n', c->len);
+
+    c->head_len = (size_t)(first - c->data) + 1;
+    c->tail_off = (size_t)(last - c->data) + 1;
+
+    size_t lines = search_span(run->ctx, c->data + c->head_len, c->tail_off - c->head_len, &c->matches);
+    if (lines == (size_t)-1) {
+        c->error = 1;
+        return;
+    }
+    c->newlines = 1 + lines;
+}
+
+/**
+ * @brief A worker thread and the NUMA node it runs on.
+ */
+struct parallel_worker {
+    struct parallel_run *run;
+    unsigned node;
+    pthread_t thread;
+};
+
+/**
+ * @brief Claims the next chunk inside the window, preferring the worker's own
+ * node and taking another node's chunk only when its own has none ready.
+ * Called with run->lock held.
+ * @return 1 if a chunk was claimed, 0 if none can be claimed now.
+ */
+static int claim_chunk(struct parallel_run *run, unsigned node, size_t *index)
+{
+    for (unsigned k = 0; k < run->nodes; k++) {
+        size_t *next = &run->next[(node + k) % run->nodes];
+        if (*next < run->count && *next - run->emitted < run->window) {
+            *index = *next;
+            *next += run->nodes;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Checks whether any chunk is still unclaimed. Called with run->lock held.
+ */
+static int chunks_left(const struct parallel_run *run)
+{
+    for (unsigned n = 0; n < run->nodes; n++) {
+        if (run->next[n] < run->count) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *parallel_worker(void *arg)
+{
+    struct parallel_worker *w = arg;
+    struct parallel_run *run = w->run;
+
+    // Pinned before the first chunk, so decoded frames are allocated on the node.
+    numa_pin(w->node);
+
+    pthread_mutex_lock(&run->lock);
+    for (;;) {
+        size_t index;
+        int claimed = 0;
+        while (!run->stop && !(claimed = claim_chunk(run, w->node, &index)) && chunks_left(run)) {
+            pthread_cond_wait(&run->cond, &run->lock);
+        }
+        if (!claimed) {
+            break;
+        }
+        struct chunk *c = &run->slots[index % run->window];
+        pthread_mutex_unlock(&run->lock);
+
+        uint64_t start = stats_now_ns();
+        scan_chunk(run, index, c);
+        numa_account(c->len, stats_now_ns() - start);
+
+        pthread_mutex_lock(&run->lock);
+        c->done = 1;
+        pthread_cond_broadcast(&run->cond);
+    }
+    pthread_mutex_unlock(&run->lock);
+    numa_unpin();
+    return NULL;
+}
+
+/**
+ * @brief Appends bytes to the stitch buffer for a line that spans chunks.
+ */
+static int carry_append(char **carry, size_t *len, size_t *cap, const char *data, size_t n)
+{
+    if (*len + n > *cap) {
+        size_t grown_cap = *cap ? *cap : 4096;
+        while (grown_cap < *len + n) {
+            grown_cap *= 2;
+        }
+        char *grown = realloc(*carry, grown_cap);
+        if (grown == NULL) {
+            return -1;
+        }
+        *carry = grown;
+        *cap = grown_cap;
+    }
+    memcpy(*carry + *len, data, n);
+    *len += n;
+    return 0;
+}
+
+/**
+ * @brief Runs the workers and prints every chunk in order.
+ */
+static int parallel_run(struct search_ctx *ctx, struct parallel_run *run, unsigned threads)
+{
+    if (threads == 0) {
+        threads = 1;
+    }
+    run->ctx = ctx;
+    run->window = parallel_budget_buffers(PARALLEL_CHUNK_SIZE, threads,
+                                          (size_t)threads * PARALLEL_WINDOW_PER_THREAD);
+    run->slots = calloc(run->window, sizeof(*run->slots));
+    struct parallel_worker *workers = calloc(threads, sizeof(*workers));
+    if (run->slots == NULL || workers == NULL) {
+        free(run->slots);
+        free(workers);
+        return -1;
+    }
+    pthread_mutex_init(&run->lock, NULL);
+    pthread_cond_init(&run->cond, NULL);
+
+    // Chunk i is dealt to node i % nodes, and worker t runs on node t % nodes.
+    run->nodes = numa_node_count() < threads ? numa_node_count() : threads;
+    for (unsigned n = 0; n < run->nodes; n++) {
+        run->next[n] = n;
+    }
+    unsigned started = 0;
+    while (started < threads) {
+        workers[started].run = run;
+        workers[started].node = started % run->nodes;
+        if (pthread_create(&workers[started].thread, NULL, parallel_worker, &workers[started]) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    int rc = started > 0 ? 0 : -1;
+    uint64_t lines_before = run->lines_before; // Newlines before the current chunk
+    int skipping = run->skip_head;
+    char *carry = NULL;
+    size_t carry_len = 0, carry_cap = 0;
+
+    for (size_t i = 0; rc == 0 && !ctx->done && i < run->count; i++) {
+        // Chunks picked from a larger run carry their own starting line.
+        if (run->chunk_lines != NULL) {
+            lines_before = run->chunk_lines[i];
+        }
+
+        // Every line from here on starts after the end of the range.
+        if (search_past_range(ctx, lines_before + 1)) {
+            break;
+        }
+
+        struct chunk *c = &run->slots[i % run->window];
+
+        pthread_mutex_lock(&run->lock);
+        while (!c->done) {
+            pthread_cond_wait(&run->cond, &run->lock);
+        }
+        pthread_mutex_unlock(&run->lock);
+
+        if (c->error) {
+            rc = -1;
+        } else if (run->newlines_out != NULL) {
+            run->newlines_out[i] = c->newlines;
+            lines_before += c->newlines;
+        } else if (skipping && c->newlines == 0) {
+            // Still inside the partial line the run started in.
+        } else if (c->newlines == 0) {
+            rc = carry_append(&carry, &carry_len, &carry_cap, c->data, c->len);
+        } else {
+            // The line that ends at the chunk's first newline began in an earlier chunk.
+            uint64_t linecount = lines_before + 1;
+            if (skipping) {
+                // Its start lies before the run, so it cannot be printed in full.
+                skipping = 0;
+            } else if (carry_len == 0) {
+                if (search_in_range(ctx, linecount)) {
+                    search_emit_line(ctx, linecount, c->data, c->head_len, run->stable);
+                }
+            } else if ((rc = carry_append(&carry, &carry_len, &carry_cap, c->data, c->head_len)) == 0) {
+                if (search_in_range(ctx, linecount)) {
+                    search_emit_line(ctx, linecount, carry, carry_len, 0);
+                }
+                carry_len = 0;
+            }
+
+            // Whole lines inside the chunk: index k is global line lines_before + 2 + k.
+            for (size_t m = 0; rc == 0 && m < c->matches.count; m++) {
+                const struct match *match = &c->matches.items[m];
+                linecount = lines_before + 2 + match->line_index;
+                if (search_in_range(ctx, linecount)) {
+                    search_emit_match(ctx, linecount, match->position,
+                                      c->data + c->head_len + match->line_off, match->line_len,
+                                      run->stable);
+                }
+            }
+
+            if (rc == 0) {
+                rc = carry_append(&carry, &carry_len, &carry_cap, c->data + c->tail_off, c->len - c->tail_off);
+            }
+            lines_before += c->newlines;
+        }
+
+        free(c->owned); // Unstable spans were copied by the output when printed
+        match_list_free(&c->matches);
+        memset(c, 0, sizeof(*c));
+
+        pthread_mutex_lock(&run->lock);
+        run->emitted++;
+        pthread_cond_broadcast(&run->cond);
+        pthread_mutex_unlock(&run->lock);
+    }
+
+    // A final line without a trailing newline.
+    if (rc == 0 && carry_len > 0 && search_in_range(ctx, lines_before + 1)) {
+        search_emit_line(ctx, lines_before + 1, carry, carry_len, 0);
+    }
+
+    pthread_mutex_lock(&run->lock);
+    run->stop = 1;
+    pthread_cond_broadcast(&run->cond);
+    pthread_mutex_unlock(&run->lock);
+    for (unsigned t = 0; t < started; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+
+    for (size_t s = 0; s < run->window; s++) {
+        free(run->slots[s].owned);
+        match_list_free(&run->slots[s].matches);
+    }
+    free(run->slots);
+    free(workers);
+    free(carry);
+    pthread_mutex_destroy(&run->lock);
+    pthread_cond_destroy(&run->cond);
+    return rc;
+}
+
+int parallel_search_frames(struct search_ctx *ctx, enum decoder_format format,
+                           const struct frame *frames, size_t count, uint64_t lines_before,
+                           unsigned threads)
+{
+    struct parallel_run run = {
+        .load = load_frame,
+        .count = count,
+        .stable = 0,
+        .format = format,
+        .frames = frames,
+        .lines_before = lines_before,
+        .skip_head = lines_before > 0,
+    };
+    return parallel_run(ctx, &run, threads);
+}
+
+int parallel_count_frames(enum decoder_format format, const struct frame *frames, size_t count,
+                          unsigned threads, uint64_t *newlines)
+{
+    // An empty term matches nothing, so workers only walk the lines.
+    struct search_ctx ctx = { .term = "", .term_len = 0 };
+    struct parallel_run run = {
+        .load = load_frame,
+        .count = count,
+        .format = format,
+        .frames = frames,
+        .newlines_out = newlines,
+    };
+    return parallel_run(&ctx, &run, threads);
+}
+
+int parallel_search_mapped(struct search_ctx *ctx, const char *data, size_t len, uint64_t lines_before,
+                           unsigned threads)
+{
+    size_t count = (len + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+    if (count == 0) {
+        return 0;
+    }
+    if (!(ctx->options & OPTION_RANGE)) {
+        struct parallel_run run = {
+            .load = load_mapped,
+            .count = count,
+            .stable = 1,
+            .map = data,
+            .map_len = len,
+            .lines_before = lines_before,
+        };
+        return parallel_run(ctx, &run, threads);
+    }
+
+    // With --range, first count the newlines of every chunk (in parallel, and
+    // only up to the end of the last range), then search just the chunks that
+    // hold lines in a range.
+    uint64_t *newlines = malloc(count * sizeof(*newlines));
+    size_t *ids = malloc(count * sizeof(*ids));
+    uint64_t *before = malloc(count * sizeof(*before));
+    if (newlines == NULL || ids == NULL || before == NULL) {
+        free(newlines);
+        free(ids);
+        free(before);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        newlines[i] = UINT64_MAX; // Not counted: past the last range
+    }
+
+    struct search_ctx counter = *ctx; // Only its ranges are used, to stop counting
+    struct parallel_run counting = {
+        .load = load_mapped,
+        .count = count,
+        .count_only = 1,
+        .map = data,
+        .map_len = len,
+        .lines_before = lines_before,
+        .newlines_out = newlines,
+    };
+    int rc = parallel_run(&counter, &counting, threads);
+
+    size_t picked = 0;
+    uint64_t lines = lines_before;
+    for (size_t i = 0; rc == 0 && i < count && newlines[i] != UINT64_MAX; i++) {
+        // The chunk holds lines lines+1 to lines+newlines[i] (+1 for an unfinished last line).
+        uint64_t next = search_next_in_range(ctx, lines + 1);
+        if (next != 0 && next <= lines + newlines[i] + 1) {
+            ids[picked] = i;
+            before[picked] = lines;
+            picked++;
+        }
+        lines += newlines[i];
+    }
+
+    if (rc == 0 && picked > 0) {
+        struct parallel_run run = {
+            .load = load_mapped,
+            .count = picked,
+            .stable = 1,
+            .map = data,
+            .map_len = len,
+            .chunk_ids = ids,
+            .chunk_lines = before,
+        };
+        rc = parallel_run(ctx, &run, threads);
+    }
+
+    free(newlines);
+    free(ids);
+    free(before);
+    return rc;
+}
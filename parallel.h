@@ -0,0 +1,115 @@
+/**
+ * @file parallel.h
+ * @brief Parallel search of independent chunks with in-order output.
+ *
+ * Worker threads each take a chunk (e.g., a compressed frame), produce its
+ * bytes, search the lines that lie entirely inside it and record the matches
+ * together with the chunk's newline count. The calling thread then prints
+ * the chunks in input order, turning chunk-relative line indexes into global
+ * line numbers with a running sum of the newline counts. Lines that straddle
+ * two chunks are stitched together and searched by the calling thread.
+ */
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdint.h>
+
+#include "search.h"
+#include "decompress.h"
+
+#define PARALLEL_WINDOW_PER_THREAD 2 // Chunks in flight per worker (bounds memory)
+#define PARALLEL_MAX_THREADS 1024    // Most worker threads --threads accepts
+#define PARALLEL_CHUNK_SIZE (8 << 20) // Bytes of a mapped file per chunk
+#define PARALLEL_MEMORY_SHARE 4      // In-flight buffers may use 1/this of the memory limit
+
+/**
+ * @brief The CPUs and memory a run may use, and the defaults derived from them.
+ */
+struct parallel_limits {
+    unsigned affinity_cpus;     // CPUs in the affinity mask (or online)
+    double cgroup_cpus;         // cgroup cpu.max quota in CPUs (0 if unlimited)
+    uint64_t cgroup_memory;     // cgroup memory.max in bytes (0 if unlimited)
+    unsigned threads;           // Default worker threads
+    uint64_t buffer_budget;     // Bytes of in-flight buffers (UINT64_MAX if unlimited)
+};
+
+/**
+ * @brief Returns the limits, detected on the first call.
+ *
+ * The default thread count is the affinity mask capped by the cgroup CPU
+ * quota (rounded up), so a container limited to two CPUs on a large host
+ * does not start a thread per host core. The buffer budget is a share of the
+ * cgroup memory limit; parallel searches and pipelines keep fewer chunks and
+ * blocks in flight to stay within it.
+ */
+const struct parallel_limits *parallel_limits(void);
+
+/**
+ * @brief Returns the default number of worker threads (the CPUs this process may use).
+ */
+unsigned parallel_default_threads(void);
+
+/**
+ * @brief Returns how many buffers of a size fit in the budget, but at least min and at most max.
+ */
+size_t parallel_budget_buffers(size_t size, size_t min, size_t max);
+
+/**
+ * @brief Decodes and searches independent compressed frames in parallel.
+ *
+ * The frames may start part way into the input (e.g., at a block picked from
+ * a line index); lines_before then gives the newlines in the skipped part.
+ * The line that is still open where the first frame starts is not printed.
+ *
+ * @param ctx The search context; results are printed to ctx->out in file order.
+ * @param format The compressed format of the frames.
+ * @param frames The frames, in file order.
+ * @param count The number of frames.
+ * @param lines_before The number of newlines before the first frame.
+ * @param threads The number of worker threads.
+ * @return 0 on success, -1 if a frame could not be decoded (output stops there).
+ */
+int parallel_search_frames(struct search_ctx *ctx, enum decoder_format format,
+                           const struct frame *frames, size_t count, uint64_t lines_before,
+                           unsigned threads);
+
+/**
+ * @brief Finds where a line-aligned chunk of a mapped file starts: just past
+ * the first newline at or after chunk * PARALLEL_CHUNK_SIZE.
+ *
+ * @return The offset (len once past the end).
+ */
+size_t parallel_chunk_start(const char *data, size_t len, size_t chunk);
+
+/**
+ * @brief Searches a mapped file in parallel, in chunks aligned to lines.
+ *
+ * Each chunk records its newline count and the printed line numbers are the
+ * running sum of those counts, so the output is the same as a serial scan.
+ * With --range, the chunks are first counted (up to the end of the last
+ * range) and only the chunks holding lines in a range are searched.
+ *
+ * @param ctx The search context; results are printed to ctx->out in file order.
+ * @param data The mapped bytes, starting at a line.
+ * @param len The number of bytes.
+ * @param lines_before The number of lines before data.
+ * @param threads The number of worker threads.
+ * @return 0 on success, -1 if out of memory.
+ */
+int parallel_search_mapped(struct search_ctx *ctx, const char *data, size_t len, uint64_t lines_before,
+                           unsigned threads);
+
+/**
+ * @brief Decodes frames in parallel and counts the newlines in each one.
+ *
+ * @param format The compressed format of the frames.
+ * @param frames The frames, in file order.
+ * @param count The number of frames.
+ * @param threads The number of worker threads.
+ * @param newlines Receives the newline count of every frame (count entries).
+ * @return 0 on success, -1 if a frame could not be decoded.
+ */
+int parallel_count_frames(enum decoder_format format, const struct frame *frames, size_t count,
+                          unsigned threads, uint64_t *newlines);
+
+#endif // PARALLEL_H
@@ -0,0 +1,329 @@
+/**
+ * @file pipeline.c
+ * @brief Implementation of the stream search pipeline.
+ */
+
+#define _GNU_SOURCE
+#include "pipeline.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hugepage.h"
+#include "numa.h"
+#include "parallel.h"
+#include "ring.h"
+#include "stats.h"
+
+/**
+ * @brief A block of input and the matches found in it.
+ */
+struct pipeline_block {
+    char *data;
+    size_t len;
+    size_t cap;
+    size_t whole;               // Bytes of complete lines; the rest is a final unterminated line
+    struct match_list matches;
+    uint64_t newlines;
+    int error;
+    int paused;                 // The input paused after this block: print its results right away
+    int end;                    // Marker: no blocks follow (error: reading failed)
+};
+
+struct pipeline;
+
+struct pipeline_matcher {
+    struct pipeline *pl;
+    pthread_t thread;
+    unsigned node;              // NUMA node the matcher runs on
+    struct ring in;             // Blocks from the reader
+    struct ring out;            // Searched blocks to the writer
+    struct pipeline_block end;  // This matcher's end marker
+};
+
+struct pipeline {
+    struct search_ctx proto;    // Read by the matchers; the writer updates the caller's
+    struct reader *reader;
+    struct pipeline_matcher *matchers;
+    unsigned matcher_count;
+    struct pipeline_block *blocks;
+    size_t block_count;
+    struct ring free;           // Empty blocks from the writer back to the reader
+    int stop;                   // Set by the writer once nothing more will be printed
+};
+
+/**
+ * @brief Makes room for need bytes in a block, keeping its contents.
+ */
+static int pipeline_grow(struct pipeline_block *b, size_t need)
+{
+    if (need <= b->cap) {
+        return 0;
+    }
+    size_t cap = b->cap;
+    while (cap < need) {
+        cap *= 2;
+    }
+    char *grown = hugepage_alloc(cap);
+    if (grown == NULL) {
+        return -1;
+    }
+    memcpy(grown, b->data, b->len);
+    hugepage_free(b->data, b->cap);
+    b->data = grown;
+    b->cap = cap;
+    return 0;
+}
+
+/**
+ * @brief Sends the complete lines of the current block to the next matcher
+ * and moves the unfinished line into a fresh block.
+ * @param paused Non-zero if the input paused, so the writer flushes the block's results.
+ * @return 1 if sent, 0 if the block holds no complete line yet, -1 if out of memory.
+ */
+static int pipeline_ship(struct pipeline *pl, struct pipeline_block **cur, size_t *seq, int paused)
+{
+    struct pipeline_block *b = *cur;
+    const char *nl = b->len ? memrchr(b->data, '\n', b->len) : NULL;
+    if (nl == NULL) {
+        return 0;
+    }
+    size_t whole = (size_t)(nl - b->data) + 1;
+
+    struct pipeline_block *next = ring_pop(&pl->free);
+    next->len = 0;
+    if (pipeline_grow(next, b->len - whole) < 0) {
+        return -1;
+    }
+    memcpy(next->data, b->data + whole, b->len - whole);
+    next->len = b->len - whole;
+
+    b->len = whole;
+    b->paused = paused;
+    ring_push(&pl->matchers[*seq % pl->matcher_count].in, b);
+    (*seq)++;
+    *cur = next;
+    return 1;
+}
+
+static void *pipeline_read(void *arg)
+{
+    struct pipeline *pl = arg;
+    struct pipeline_block *cur = ring_pop(&pl->free);
+    size_t seq = 0;
+    int rc = 0;
+    const char *data;
+    size_t len;
+
+    cur->len = 0;
+    while (rc >= 0 && !__atomic_load_n(&pl->stop, __ATOMIC_RELAXED) &&
+           (rc = reader_next_block(pl->reader, &data, &len)) > 0) {
+        // A short block means the input paused: pass on what has arrived.
+        int paused = len < READER_BLOCK_SIZE;
+
+        while (len > 0) {
+            if (cur->len == cur->cap) {
+                int shipped = pipeline_ship(pl, &cur, &seq, 0);
+                if (shipped < 0 || (shipped == 0 && pipeline_grow(cur, cur->cap * 2) < 0)) {
+                    rc = -1;
+                    break;
+                }
+            }
+            size_t n = len < cur->cap - cur->len ? len : cur->cap - cur->len;
+            memcpy(cur->data + cur->len, data, n);
+            cur->len += n;
+            data += n;
+            len -= n;
+        }
+        if (rc > 0 && paused && pipeline_ship(pl, &cur, &seq, 1) < 0) {
+            rc = -1;
+        }
+    }
+
+    // The rest, including a final line without a newline, then the end markers.
+    if (rc == 0 && cur->len > 0) {
+        ring_push(&pl->matchers[seq % pl->matcher_count].in, cur);
+    }
+    for (unsigned i = 0; i < pl->matcher_count; i++) {
+        pl->matchers[i].end.error = rc < 0;
+        ring_push(&pl->matchers[i].in, &pl->matchers[i].end);
+    }
+    return NULL;
+}
+
+static void *pipeline_match(void *arg)
+{
+    struct pipeline_matcher *m = arg;
+    struct pipeline *pl = m->pl;
+
+    numa_pin(m->node);
+    for (;;) {
+        struct pipeline_block *b = ring_pop(&m->in);
+        if (!b->end) {
+            b->matches.count = 0;
+            b->newlines = 0;
+            b->error = 0;
+            b->whole = 0;
+            if (!__atomic_load_n(&pl->stop, __ATOMIC_RELAXED)) {
+                uint64_t start = stats_now_ns();
+                const char *nl = memrchr(b->data, '\n', b->len);
+                b->whole = nl != NULL ? (size_t)(nl - b->data) + 1 : 0;
+                size_t lines = search_span(&pl->proto, b->data, b->whole, &b->matches);
+                numa_account(b->len, stats_now_ns() - start);
+                if (lines == (size_t)-1) {
+                    b->error = 1;
+                } else {
+                    b->newlines = lines;
+                }
+            }
+        }
+        ring_push(&m->out, b);
+        if (b->end) {
+            numa_unpin();
+            return NULL;
+        }
+    }
+}
+
+/**
+ * @brief Prints one searched block.
+ * @return The number of lines in it (with a final unterminated line).
+ */
+static uint64_t pipeline_print(struct search_ctx *ctx, const struct pipeline_block *b, uint64_t lines_before)
+{
+    for (size_t m = 0; m < b->matches.count; m++) {
+        const struct match *match = &b->matches.items[m];
+        uint64_t linecount = lines_before + 1 + match->line_index;
+        if (search_in_range(ctx, linecount)) {
+            // The block is reused once printed, so lines are copied.
+            search_emit_match(ctx, linecount, match->position, b->data + match->line_off,
+                              match->line_len, 0);
+        }
+    }
+
+    uint64_t lines = b->newlines;
+    if (b->whole < b->len) {
+        if (search_in_range(ctx, lines_before + lines + 1)) {
+            search_emit_line(ctx, lines_before + lines + 1, b->data + b->whole, b->len - b->whole, 0);
+        }
+        lines++;
+    }
+    return lines;
+}
+
+/**
+ * @brief Releases the blocks and rings.
+ */
+static void pipeline_free(struct pipeline *pl)
+{
+    for (size_t i = 0; i < pl->block_count; i++) {
+        hugepage_free(pl->blocks[i].data, pl->blocks[i].cap);
+        match_list_free(&pl->blocks[i].matches);
+    }
+    for (unsigned i = 0; i < pl->matcher_count; i++) {
+        ring_free(&pl->matchers[i].in);
+        ring_free(&pl->matchers[i].out);
+    }
+    ring_free(&pl->free);
+    free(pl->blocks);
+    free(pl->matchers);
+}
+
+int pipeline_search(struct search_ctx *ctx, struct reader *reader, uint64_t lines_before,
+                    unsigned matchers)
+{
+    if (matchers == 0) {
+        matchers = 1;
+    }
+    struct pipeline pl = {
+        .proto = *ctx,
+        .reader = reader,
+        .block_count = parallel_budget_buffers(PIPELINE_BLOCK_SIZE, 2,
+                                               (size_t)matchers * PIPELINE_BLOCKS_PER_MATCHER),
+    };
+
+    // Every ring can hold every block (and the end marker), so a push never waits;
+    // only taking from an empty ring does, and that is the backpressure.
+    uint32_t ring_cap = (uint32_t)pl.block_count + 1;
+    pl.blocks = calloc(pl.block_count, sizeof(*pl.blocks));
+    pl.matchers = calloc(matchers, sizeof(*pl.matchers));
+    int ok = pl.blocks != NULL && pl.matchers != NULL && ring_init(&pl.free, ring_cap) == 0;
+    unsigned nodes = numa_node_count() < matchers ? numa_node_count() : matchers;
+    for (unsigned i = 0; ok && i < matchers; i++) {
+        pl.matchers[i].pl = &pl;
+        pl.matchers[i].node = i % nodes;
+        pl.matchers[i].end.end = 1;
+        ok = ring_init(&pl.matchers[i].in, ring_cap) == 0 && ring_init(&pl.matchers[i].out, ring_cap) == 0;
+        pl.matcher_count = i + 1;
+    }
+    for (size_t i = 0; ok && i < pl.block_count; i++) {
+        pl.blocks[i].data = hugepage_alloc(PIPELINE_BLOCK_SIZE);
+        pl.blocks[i].cap = PIPELINE_BLOCK_SIZE;
+        ok = pl.blocks[i].data != NULL;
+        if (ok) {
+            ring_push(&pl.free, &pl.blocks[i]);
+        }
+    }
+    if (!ok) {
+        pipeline_free(&pl);
+        fprintf(stderr, "search: Out of memory.\n");
+        return -1;
+    }
+
+    // Matchers that fail to start shrink the round-robin before the reader uses it.
+    unsigned started = 0;
+    while (started < matchers &&
+           pthread_create(&pl.matchers[started].thread, NULL, pipeline_match, &pl.matchers[started]) == 0) {
+        started++;
+    }
+    pl.matcher_count = started;
+    pthread_t reader_thread;
+    if (started == 0 || pthread_create(&reader_thread, NULL, pipeline_read, &pl) != 0) {
+        for (unsigned i = 0; i < started; i++) {
+            ring_push(&pl.matchers[i].in, &pl.matchers[i].end);
+            pthread_join(pl.matchers[i].thread, NULL);
+        }
+        pl.matcher_count = matchers;
+        pipeline_free(&pl);
+        fprintf(stderr, "search: Could not start worker threads.\n");
+        return -1;
+    }
+
+    // Writer: blocks come back in the order they were read, from matcher seq % count.
+    int rc = 0;
+    int stopped = 0;
+    uint64_t lines = lines_before;
+    for (size_t seq = 0;; seq++) {
+        struct pipeline_block *b = ring_pop(&pl.matchers[seq % started].out);
+        if (b->end) {
+            if (b->error) {
+                rc = -1;
+            }
+            break;
+        }
+        if (!stopped && b->error) {
+            rc = -1;
+            stopped = 1;
+        } else if (!stopped) {
+            lines += pipeline_print(ctx, b, lines);
+            stopped = ctx->done || search_past_range(ctx, lines + 1);
+            if (b->paused) {
+                output_flush(ctx->out); // The next block may be a while coming
+            }
+        }
+        if (stopped) {
+            __atomic_store_n(&pl.stop, 1, __ATOMIC_RELAXED);
+        }
+        ring_push(&pl.free, b);
+    }
+
+    pthread_join(reader_thread, NULL);
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(pl.matchers[i].thread, NULL);
+    }
+    pl.matcher_count = matchers;
+    pipeline_free(&pl);
+    return rc;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file pipeline.h
+ * @brief Reader, matcher and writer stages for searching a stream on several threads.
+ *
+ * A reader thread copies the input into blocks of whole lines and hands them
+ * out round-robin to the matcher threads, each over its own single-producer/
+ * single-consumer ring. A matcher records the matches of a block and passes
+ * it on over another ring, and the calling thread, the writer, takes the
+ * blocks back in input order, numbers and prints the matches, and returns
+ * the block to the reader. A fixed set of blocks circulates, so a slow stage
+ * holds the others back instead of letting memory grow.
+ */
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+
+#include "reader.h"
+#include "search.h"
+
+#define PIPELINE_BLOCK_SIZE (2 << 20)     // Bytes of whole lines in a block (grown for longer lines)
+#define PIPELINE_BLOCKS_PER_MATCHER 4     // Blocks in flight per matcher
+
+/**
+ * @brief Searches the rest of a stream on a pipeline.
+ *
+ * Partial lines are carried from one block to the next, so every line is
+ * matched whole. Reading stops once no later line can be printed.
+ *
+ * @param ctx The search context; results are printed to ctx->out.
+ * @param reader The input; it is read from the reader thread.
+ * @param lines_before The number of lines before the first one read.
+ * @param matchers The number of matcher threads.
+ * @return 0 on success, -1 on a read error or if out of memory.
+ */
+int pipeline_search(struct search_ctx *ctx, struct reader *reader, uint64_t lines_before,
+                    unsigned matchers);
+
+#endif // PIPELINE_H
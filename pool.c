@@ -0,0 +1,768 @@
+/**
+ * @file pool.c
+ * @brief Implementation of the multi-file thread pool.
+ */
+
+#define _GNU_SOURCE
+#include "pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "memscan.h"
+#include "numa.h"
+#include "parallel.h"
+#include "reader.h"
+#include "scan.h"
+#include "walk.h"
+
+enum pool_task_kind {
+    POOL_TASK_FILES,            // Search jobs [job, job + count) one after the other
+    POOL_TASK_CHUNK             // Search chunk `count` of the split file in job `job`
+};
+
+struct pool_task {
+    enum pool_task_kind kind;
+    size_t job;                 // Index of the (first) job
+    size_t count;               // Files in the batch, or the chunk number
+};
+
+/**
+ * @brief A chunk of a split file and the matches found in it.
+ */
+struct pool_chunk {
+    size_t start;               // Offset of the chunk in the mapping
+    struct match_list matches;
+    uint64_t newlines;
+    int error;
+    int done;
+};
+
+/**
+ * @brief A file in flight and the results found in it.
+ */
+struct pool_job {
+    struct walk_file file;
+    off_t size;                 // Size of a regular file, else -1
+    size_t result_off;          // Where the file's results start in its batch's arena
+    size_t result_len;
+    const char *result;         // Set once the batch is handed over
+    char *arena;                // The batch's arena, freed after this (its last) file prints
+    int rc;
+    int done;                   // Results are ready (or, when split, the chunks are queued)
+
+    // A large file opened to be split; its chunks' results are printed by the sequencer.
+    int opened;                 // reader holds the file
+    struct reader reader;
+    struct pool_chunk *chunks;
+    size_t chunk_count;
+    size_t chunks_done;
+    int cancel;                 // Nothing more will be printed; skip the remaining chunks
+};
+
+/**
+ * @brief A worker's task deque: the owner works at the tail, thieves take from the head.
+ */
+struct pool_deque {
+    pthread_mutex_t lock;
+    struct pool_task *tasks;    // Ring of cap tasks
+    size_t cap;
+    size_t head;                // Oldest task
+    size_t count;
+};
+
+struct pool;
+
+/**
+ * @brief A worker. Workers are cache-line aligned, and the deque, which
+ * thieves lock, is on a line apart from what only the owner writes.
+ */
+struct pool_worker {
+    struct pool *p;
+    unsigned id;
+    pthread_t thread;
+    unsigned seed;              // Picks where to start looking for a victim
+    unsigned node;              // NUMA node the worker runs on
+    struct output arena;        // Memory sink collecting the current batch's results
+    struct worker_stats stats;
+    uint64_t results;           // Results found in whole files
+    struct pool_deque deque __attribute__((aligned(POOL_CACHE_LINE)));
+} __attribute__((aligned(POOL_CACHE_LINE)));
+
+struct pool {
+    const struct search_ctx *ctx;
+    int binary_mode;
+
+    // File source, used under source_lock so files are taken in order
+    pthread_mutex_t source_lock;
+    char **paths;
+    size_t count;
+    size_t index;
+    int recursive;
+    struct walker *walker;
+    unsigned walk_threads;
+    int source_failed;
+
+    struct pool_worker *workers;
+    unsigned worker_count;
+
+    struct pool_job *jobs;      // Ring of `window` jobs; file i uses job i % window
+    size_t window;
+    size_t taken;               // Files taken from the source
+    size_t printed;             // Files printed so far
+    int exhausted;              // The source has no more files
+    size_t queued;              // Tasks waiting in some deque
+    unsigned taking;            // Workers turning taken files into tasks
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static int deque_push(struct pool_deque *d, struct pool_task task)
+{
+    pthread_mutex_lock(&d->lock);
+    if (d->count == d->cap) {
+        size_t cap = d->cap ? d->cap * 2 : 64;
+        struct pool_task *grown = malloc(cap * sizeof(*grown));
+        if (grown == NULL) {
+            pthread_mutex_unlock(&d->lock);
+            return -1;
+        }
+        for (size_t i = 0; i < d->count; i++) {
+            grown[i] = d->tasks[(d->head + i) % d->cap];
+        }
+        free(d->tasks);
+        d->tasks = grown;
+        d->cap = cap;
+        d->head = 0;
+    }
+    d->tasks[(d->head + d->count) % d->cap] = task;
+    d->count++;
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+}
+
+/**
+ * @brief Takes the newest task (owner) or the oldest one (thief).
+ * @return 1 if a task was taken, 0 if the deque is empty.
+ */
+static int deque_take(struct pool_deque *d, struct pool_task *task, int steal)
+{
+    int got = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->count > 0) {
+        if (steal) {
+            *task = d->tasks[d->head];
+            d->head = (d->head + 1) % d->cap;
+        } else {
+            *task = d->tasks[(d->head + d->count - 1) % d->cap];
+        }
+        d->count--;
+        got = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return got;
+}
+
+/**
+ * @brief Queues a task on a worker's deque (at the owner's end) and wakes an idle worker.
+ */
+static int pool_push(struct pool_worker *w, struct pool_task task)
+{
+    struct pool *p = w->p;
+    if (deque_push(&w->deque, task) < 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&p->lock);
+    p->queued++;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    return 0;
+}
+
+/**
+ * @brief Takes a task from the worker's own deque, or else steals one from
+ * another worker, starting at a random victim: first from the workers on
+ * the same NUMA node, then from the others.
+ * @return 1 if a task was taken, 0 if every deque is empty.
+ */
+static int pool_pop(struct pool_worker *w, struct pool_task *task)
+{
+    struct pool *p = w->p;
+    int got = deque_take(&w->deque, task, 0);
+
+    if (!got && p->worker_count > 1) {
+        unsigned start = (unsigned)rand_r(&w->seed) % p->worker_count;
+        for (int local = 1; local >= 0 && !got; local--) {
+            for (unsigned i = 0; i < p->worker_count && !got; i++) {
+                struct pool_worker *victim = &p->workers[(start + i) % p->worker_count];
+                if (victim != w && (victim->node == w->node) == local &&
+                    deque_take(&victim->deque, task, 1)) {
+                    w->stats.steals++;
+                    got = 1;
+                }
+            }
+        }
+    }
+    if (got) {
+        pthread_mutex_lock(&p->lock);
+        p->queued--;
+        pthread_mutex_unlock(&p->lock);
+    }
+    return got;
+}
+
+/**
+ * @brief Takes the next file from the command line or the walk. Called with
+ * source_lock held.
+ * @return 1 if a file was returned, 0 when there are no more.
+ */
+static int pool_next_file(struct pool *p, struct walk_file *file)
+{
+    for (;;) {
+        if (p->walker != NULL) {
+            if (walk_next(p->walker, file)) {
+                return 1;
+            }
+            if (walk_finish(p->walker) > 0) {
+                p->source_failed = 1;
+            }
+            p->walker = NULL;
+        }
+        if (p->index == p->count) {
+            return 0;
+        }
+
+        const char *path = p->paths[p->index++];
+        if (strcmp(path, "-") == 0) {
+            file->fd = STDIN_FILENO;
+            file->path = strdup(path);
+        } else if (p->recursive) {
+            p->walker = walk_start(path, p->walk_threads);
+            if (p->walker == NULL) {
+                fprintf(stderr, "search: %s: %s\n", path, strerror(errno));
+                p->source_failed = 1;
+            }
+            continue;
+        } else {
+            file->fd = open(path, O_RDONLY | O_CLOEXEC);
+            if (file->fd < 0) {
+                fprintf(stderr, "search: %s: %s\n", path, strerror(errno));
+                p->source_failed = 1;
+                continue;
+            }
+            file->path = strdup(path);
+        }
+
+        if (file->path == NULL) {
+            close(file->fd);
+            p->source_failed = 1;
+            continue;
+        }
+        return 1;
+    }
+}
+
+/**
+ * @brief Takes the next files in order: a run of small files up to
+ * POOL_BATCH_BYTES, ended early by the first file that is not small.
+ * @return The number of files taken; the first is job *first.
+ */
+static size_t pool_take(struct pool *p, size_t *first)
+{
+    pthread_mutex_lock(&p->source_lock);
+    pthread_mutex_lock(&p->lock);
+    size_t room = p->window - (p->taken - p->printed);
+    size_t index = p->taken;
+    int exhausted = p->exhausted;
+    pthread_mutex_unlock(&p->lock);
+
+    size_t n = 0;
+    off_t bytes = 0;
+    while (!exhausted && n < room && n < POOL_BATCH_FILES) {
+        struct walk_file file;
+        if (!pool_next_file(p, &file)) {
+            exhausted = 1;
+            break;
+        }
+
+        struct stat st;
+        struct pool_job *job = &p->jobs[(index + n) % p->window];
+        job->file = file;
+        job->size = fstat(file.fd, &st) == 0 && S_ISREG(st.st_mode) ? st.st_size : -1;
+        n++;
+        if (job->size < 0 || job->size >= POOL_SMALL_FILE) {
+            break;
+        }
+        if ((bytes += job->size) >= POOL_BATCH_BYTES) {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&p->lock);
+    p->taken += n;
+    if (exhausted) {
+        p->exhausted = 1;
+    }
+    if (n > 0) {
+        p->taking++;
+    }
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    pthread_mutex_unlock(&p->source_lock);
+
+    *first = index;
+    return n;
+}
+
+/**
+ * @brief Splits a large plain file into chunk tasks for the sequencer to print.
+ * @return 1 if the file was split, 0 if it is searched whole, -1 if it could not be opened.
+ */
+static int pool_split(struct pool_worker *w, size_t index)
+{
+    struct pool *p = w->p;
+    struct pool_job *job = &p->jobs[index % p->window];
+
+    if (reader_open_fd(&job->reader, job->file.fd, job->file.path) < 0) {
+        fprintf(stderr, "search: %s: %s\n", job->file.path, reader_strerror(errno));
+        return -1;
+    }
+    job->opened = 1;
+
+    // Only plain text is split; anything else is searched whole from the open reader.
+    const char *head;
+    size_t headlen;
+    size_t chunks = (job->reader.map_len + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+    if (!job->reader.mapped || job->reader.format != DECODER_NONE || chunks < 2 ||
+        (p->binary_mode != BINARY_TEXT && reader_peek(&job->reader, &head, &headlen) == 0 &&
+         memscan_has_nul(head, headlen))) {
+        return 0;
+    }
+
+    job->chunks = calloc(chunks, sizeof(*job->chunks));
+    if (job->chunks == NULL) {
+        return 0;
+    }
+    for (size_t k = 0; k < chunks; k++) {
+        job->chunks[k].start = parallel_chunk_start(job->reader.map, job->reader.map_len, k);
+    }
+    job->chunk_count = chunks;
+
+    // Chunk k goes to worker k % count, so the chunks are dealt across the NUMA
+    // nodes (worker i runs on node i % nodes). They are pushed last chunk first, so
+    // each owner works from the front of the file (which prints first) while
+    // thieves take from the back.
+    size_t k = chunks;
+    while (k > 0) {
+        struct pool_task task = { .kind = POOL_TASK_CHUNK, .job = index, .count = k - 1 };
+        if (pool_push(&p->workers[(k - 1) % p->worker_count], task) < 0) {
+            break;
+        }
+        k--;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    job->chunks_done += k; // Chunks that could not be queued are never searched
+    job->cancel = k > 0;
+    job->rc = k > 0 ? -1 : 0;
+    job->done = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    return 1;
+}
+
+static uint64_t pool_run_task(struct pool_worker *w, const struct pool_task *task);
+
+/**
+ * @brief Turns taken files into tasks on the worker's own deque: the small
+ * files in one batch, and a large last file in chunks.
+ */
+static void pool_dispatch(struct pool_worker *w, size_t first, size_t n)
+{
+    struct pool *p = w->p;
+    struct pool_job *last = &p->jobs[(first + n - 1) % p->window];
+    size_t batch = n;
+
+    if (last->size >= 2 * (off_t)PARALLEL_CHUNK_SIZE) {
+        int split = pool_split(w, first + n - 1);
+        if (split < 0) {
+            pthread_mutex_lock(&p->lock);
+            last->rc = -1;
+            last->done = 1;
+            pthread_cond_broadcast(&p->cond);
+            pthread_mutex_unlock(&p->lock);
+        }
+        if (split != 0) {
+            batch--;
+        }
+    }
+
+    if (batch > 0) {
+        struct pool_task task = { .kind = POOL_TASK_FILES, .job = first, .count = batch };
+        if (pool_push(w, task) < 0) {
+            // No room to queue it: search the batch here instead.
+            pool_run_task(w, &task);
+        }
+    }
+}
+
+/**
+ * @brief Searches one file, appending its results to the worker's arena.
+ */
+static void pool_run_job(struct pool_worker *w, struct pool_job *job)
+{
+    struct pool *p = w->p;
+    int stdin_input = strcmp(job->file.path, "-") == 0;
+    const char *name = stdin_input ? "(standard input)" : job->file.path;
+    struct search_ctx ctx = *p->ctx;
+    ctx.out = &w->arena;
+    ctx.results = 0;
+    ctx.show_name = 1;
+
+    // The arena may move as it grows, so only the offset is kept for now.
+    job->result_off = w->arena.mem_len;
+    if (job->opened) {
+        job->rc = scan_reader(&ctx, &job->reader, name, p->binary_mode, 1);
+    } else {
+        job->rc = scan_file(&ctx, job->file.fd, stdin_input ? NULL : job->file.path, name,
+                            p->binary_mode, 1);
+    }
+    job->result_len = w->arena.mem_len - job->result_off;
+    w->results += ctx.results;
+}
+
+/**
+ * @brief Searches the whole lines of one chunk of a split file.
+ */
+static size_t pool_run_chunk(struct pool *p, struct pool_job *job, size_t k)
+{
+    struct pool_chunk *c = &job->chunks[k];
+    size_t end = k + 1 < job->chunk_count ? job->chunks[k + 1].start : job->reader.map_len;
+
+    pthread_mutex_lock(&p->lock);
+    int cancel = job->cancel;
+    pthread_mutex_unlock(&p->lock);
+
+    // Chunks start just past a newline, so only the last one can end in a partial line.
+    if (!cancel && end > c->start) {
+        const char *data = job->reader.map + c->start;
+        const char *last = memrchr(data, '\n', end - c->start);
+        if (last != NULL) {
+            size_t lines = search_span(p->ctx, data, (size_t)(last - data) + 1, &c->matches);
+            if (lines == (size_t)-1) {
+                c->error = 1;
+            } else {
+                c->newlines = lines;
+            }
+        }
+    }
+
+    // Once counted as done, the chunk may be freed by the sequencer.
+    size_t bytes = cancel ? 0 : end - c->start;
+    pthread_mutex_lock(&p->lock);
+    c->done = 1;
+    job->chunks_done++;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    return bytes;
+}
+
+/**
+ * @brief Runs a task. The files of a batch share one arena, which is handed
+ * to the sequencer (and the worker starts a new one) once all are searched.
+ * @return The input bytes it covered (as far as known).
+ */
+static uint64_t pool_run_task(struct pool_worker *w, const struct pool_task *task)
+{
+    struct pool *p = w->p;
+    if (task->kind == POOL_TASK_CHUNK) {
+        return pool_run_chunk(p, &p->jobs[task->job % p->window], task->count);
+    }
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < task->count; i++) {
+        struct pool_job *job = &p->jobs[(task->job + i) % p->window];
+        if (job->size > 0) {
+            bytes += (uint64_t)job->size;
+        }
+        pool_run_job(w, job);
+    }
+
+    pthread_mutex_lock(&p->lock);
+    for (size_t i = 0; i < task->count; i++) {
+        struct pool_job *job = &p->jobs[(task->job + i) % p->window];
+        job->result = job->result_len > 0 ? w->arena.mem + job->result_off : NULL;
+        job->done = 1;
+    }
+    p->jobs[(task->job + task->count - 1) % p->window].arena = w->arena.mem;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    w->arena.mem = NULL;
+    w->arena.mem_len = 0;
+    w->arena.mem_cap = 0;
+    return bytes;
+}
+
+static void *pool_worker(void *arg)
+{
+    struct pool_worker *w = arg;
+    struct pool *p = w->p;
+
+    numa_pin(w->node);
+    for (;;) {
+        struct pool_task task;
+        if (pool_pop(w, &task)) {
+            uint64_t start = stats_now_ns();
+            uint64_t bytes = pool_run_task(w, &task);
+            uint64_t busy = stats_now_ns() - start;
+            numa_account(bytes, busy);
+            w->stats.busy_ns += busy;
+            w->stats.tasks++;
+            continue;
+        }
+
+        // Every deque is empty: take more files while the window has room.
+        size_t first;
+        size_t n = pool_take(p, &first);
+        if (n > 0) {
+            uint64_t start = stats_now_ns();
+            pool_dispatch(w, first, n);
+            w->stats.busy_ns += stats_now_ns() - start;
+
+            pthread_mutex_lock(&p->lock);
+            p->taking--;
+            pthread_cond_broadcast(&p->cond);
+            pthread_mutex_unlock(&p->lock);
+            continue;
+        }
+
+        // Wait for a task, for room in the window, or for the end.
+        pthread_mutex_lock(&p->lock);
+        while (p->queued == 0 && !(p->exhausted && p->taking == 0) &&
+               (p->exhausted || p->taken - p->printed >= p->window)) {
+            pthread_cond_wait(&p->cond, &p->lock);
+        }
+        int finished = p->queued == 0 && p->exhausted && p->taking == 0;
+        pthread_mutex_unlock(&p->lock);
+        if (finished) {
+            numa_unpin();
+            return NULL;
+        }
+    }
+}
+
+/**
+ * @brief Prints a split file's chunks in order as they complete.
+ * @return 0 on success, -1 on error.
+ */
+static int pool_print_chunks(struct pool *p, struct search_ctx *ctx, struct pool_job *job)
+{
+    int rc = job->rc;
+    uint64_t lines_before = 0; // Newlines before the current chunk
+
+    ctx->name = job->file.path;
+    ctx->show_name = 1;
+    ctx->binary = 0;
+    ctx->done = 0;
+
+    for (size_t k = 0; k < job->chunk_count; k++) {
+        struct pool_chunk *c = &job->chunks[k];
+        if (rc < 0 || ctx->done || search_past_range(ctx, lines_before + 1)) {
+            break;
+        }
+
+        pthread_mutex_lock(&p->lock);
+        while (!c->done) {
+            pthread_cond_wait(&p->cond, &p->lock);
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        if (c->error) {
+            fprintf(stderr, "search: %s: Error while reading.\n", job->file.path);
+            rc = -1;
+            break;
+        }
+        const char *data = job->reader.map + c->start;
+        for (size_t m = 0; m < c->matches.count; m++) {
+            const struct match *match = &c->matches.items[m];
+            uint64_t linecount = lines_before + 1 + match->line_index;
+            if (search_in_range(ctx, linecount)) {
+                search_emit_match(ctx, linecount, match->position, data + match->line_off,
+                                  match->line_len, 1);
+            }
+        }
+        lines_before += c->newlines;
+        match_list_free(&c->matches);
+
+        // A final line without a trailing newline.
+        if (k + 1 == job->chunk_count) {
+            const char *last = job->reader.map_len > 0 ? memrchr(job->reader.map, '\n', job->reader.map_len)
+                                                       : NULL;
+            size_t tail = last != NULL ? (size_t)(last - job->reader.map) + 1 : 0;
+            if (tail < job->reader.map_len && search_in_range(ctx, lines_before + 1)) {
+                search_emit_line(ctx, lines_before + 1, job->reader.map + tail,
+                                 job->reader.map_len - tail, 1);
+            }
+        }
+    }
+
+    // The remaining chunks are skipped, but must finish before the file is unmapped.
+    pthread_mutex_lock(&p->lock);
+    job->cancel = 1;
+    while (job->chunks_done < job->chunk_count) {
+        pthread_cond_wait(&p->cond, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    // Results reference the mapping
+    if (output_flush(ctx->out) < 0) {
+        rc = -1;
+    }
+    for (size_t k = 0; k < job->chunk_count; k++) {
+        match_list_free(&job->chunks[k].matches);
+    }
+    free(job->chunks);
+    job->chunks = NULL;
+    job->chunk_count = 0;
+    reader_close(&job->reader);
+    return rc;
+}
+
+int pool_search(struct search_ctx *ctx, char **paths, size_t count, int recursive, int binary_mode,
+                unsigned threads, struct stats *stats)
+{
+    // Workers copy a template that the sequencer does not touch
+    struct search_ctx proto = *ctx;
+    struct pool p = {
+        .ctx = &proto,
+        .binary_mode = binary_mode,
+        .paths = paths,
+        .count = count,
+        .recursive = recursive,
+        .walk_threads = threads,
+        .window = parallel_budget_buffers(OUTPUT_BUFFER_SIZE, threads,
+                                          (size_t)threads * POOL_WINDOW_PER_THREAD),
+    };
+    p.jobs = calloc(p.window, sizeof(*p.jobs));
+    p.workers = aligned_alloc(POOL_CACHE_LINE, threads * sizeof(*p.workers));
+    unsigned arenas = 0;
+    if (p.workers != NULL) {
+        memset(p.workers, 0, threads * sizeof(*p.workers));
+        while (arenas < threads && output_init_memory(&p.workers[arenas].arena) == 0) {
+            arenas++;
+        }
+    }
+    if (p.jobs == NULL || p.workers == NULL || arenas < threads) {
+        for (unsigned i = 0; p.workers != NULL && i < threads; i++) {
+            free(p.workers[i].arena.buf);
+        }
+        free(p.jobs);
+        free(p.workers);
+        fprintf(stderr, "search: Out of memory.\n");
+        return -1;
+    }
+    pthread_mutex_init(&p.source_lock, NULL);
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.cond, NULL);
+    unsigned nodes = numa_node_count() < threads ? numa_node_count() : threads;
+    for (unsigned i = 0; i < threads; i++) {
+        p.workers[i].p = &p;
+        p.workers[i].id = i;
+        p.workers[i].seed = i + 1;
+        p.workers[i].node = i % nodes;
+        pthread_mutex_init(&p.workers[i].deque.lock, NULL);
+    }
+
+    // Thieves look at every deque, including those of workers that failed to start (empty).
+    p.worker_count = threads;
+    uint64_t started_ns = stats_now_ns();
+    unsigned started = 0;
+    while (started < threads &&
+           pthread_create(&p.workers[started].thread, NULL, pool_worker, &p.workers[started]) == 0) {
+        started++;
+    }
+
+    // Sequencer: print each file's results once it and every file before it are done.
+    int rc = 0;
+    if (started == 0) {
+        fprintf(stderr, "search: Could not start worker threads.\n");
+        rc = -1;
+        p.exhausted = 1;
+    }
+    pthread_mutex_lock(&p.lock);
+    for (;;) {
+        while (p.printed == p.taken && !p.exhausted) {
+            pthread_cond_wait(&p.cond, &p.lock);
+        }
+        if (p.printed == p.taken) {
+            break;
+        }
+        struct pool_job *job = &p.jobs[p.printed % p.window];
+        while (!job->done) {
+            pthread_cond_wait(&p.cond, &p.lock);
+        }
+        pthread_mutex_unlock(&p.lock);
+
+        if (job->chunks != NULL) {
+            if (pool_print_chunks(&p, ctx, job) < 0) {
+                rc = -1;
+            }
+        } else {
+            if (job->result_len > 0 && output_write(ctx->out, job->result, job->result_len, 0) < 0) {
+                rc = -1;
+            }
+            if (job->rc < 0) {
+                rc = -1;
+            }
+            free(job->arena);
+        }
+        free(job->file.path);
+
+        pthread_mutex_lock(&p.lock);
+        memset(job, 0, sizeof(*job));
+        p.printed++;
+        pthread_cond_broadcast(&p.cond);
+    }
+    pthread_mutex_unlock(&p.lock);
+
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(p.workers[i].thread, NULL);
+    }
+    if (p.source_failed) {
+        rc = -1;
+    }
+
+    // Results in whole files were counted by the workers; those of split files are already in.
+    for (unsigned i = 0; i < threads; i++) {
+        ctx->results += p.workers[i].results;
+    }
+
+    if (stats != NULL && started > 0) {
+        stats->workers = calloc(started, sizeof(*stats->workers));
+        if (stats->workers != NULL) {
+            stats->worker_count = started;
+            stats->workers_ns = stats_now_ns() - started_ns;
+            for (unsigned i = 0; i < started; i++) {
+                stats->workers[i] = p.workers[i].stats;
+            }
+        }
+    }
+
+    for (unsigned i = 0; i < threads; i++) {
+        pthread_mutex_destroy(&p.workers[i].deque.lock);
+        free(p.workers[i].deque.tasks);
+        output_close(&p.workers[i].arena);
+    }
+    pthread_mutex_destroy(&p.source_lock);
+    pthread_mutex_destroy(&p.lock);
+    pthread_cond_destroy(&p.cond);
+    free(p.jobs);
+    free(p.workers);
+    return rc;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file pool.h
+ * @brief Searching many files on a thread pool with in-order output.
+ *
+ * Workers take files in command-line (or walk) order and turn them into
+ * tasks on their own deque: runs of small files become one batch task, and
+ * large plain files are split into line-aligned chunk tasks. A worker whose
+ * deque is empty steals the oldest task of another worker, so one huge file
+ * or a long tail of small ones keeps every worker busy. Whole files are
+ * searched into the worker's own result arena, which is handed to the
+ * sequencer a batch at a time; chunks record their matches. The calling
+ * thread acts as the sequencer: it prints results strictly in the order the
+ * files were taken, however the workers finish. At most
+ * POOL_WINDOW_PER_THREAD files per worker are in flight, which bounds the
+ * buffered results.
+ *
+ * Each worker counts its results and statistics on cache lines of its own;
+ * the counts are added up once the workers are done.
+ */
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+#include "search.h"
+#include "stats.h"
+
+#define POOL_WINDOW_PER_THREAD 64        // Files in flight per worker
+#define POOL_SMALL_FILE (256 * 1024)     // Files smaller than this are batched
+#define POOL_BATCH_BYTES (1024 * 1024)   // Bytes of small files per batch task
+#define POOL_BATCH_FILES 32              // Files per batch task
+#define POOL_CACHE_LINE 64               // Workers' counters are kept this far apart
+
+/**
+ * @brief Searches files on a thread pool, naming the file in front of each result.
+ *
+ * @param ctx The search context (the template for every file); results are
+ *            printed to ctx->out and counted in ctx->results.
+ * @param paths The files (or, with recursive, the directories) to search; "-" is standard input.
+ * @param count The number of paths.
+ * @param recursive Walk directories and search every file under them.
+ * @param binary_mode What to do with binary input (enum binary_mode).
+ * @param threads The number of worker threads (and directory walker threads).
+ * @param stats Receives per-worker statistics, or NULL.
+ * @return 0 on success, -1 if any file or directory could not be read.
+ */
+int pool_search(struct search_ctx *ctx, char **paths, size_t count, int recursive, int binary_mode,
+                unsigned threads, struct stats *stats);
+
+#endif // POOL_H
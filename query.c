@@ -0,0 +1,508 @@
+/**
+ * @file query.c
+ * @brief Implementation of the shared-scan multi-query search.
+ */
+
+#define _GNU_SOURCE
+#include "query.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @brief Splits a query line into words in place. Quotes group words and a
+ * backslash escapes the next character (except inside single quotes).
+ * @return The number of words, or -1 on an unterminated quote or too many words.
+ */
+static int query_split(char *line, char **words, int max)
+{
+    int count = 0;
+    char *src = line;
+    char *dst = line;
+
+    for (;;) {
+        while (*src == ' ' || *src == '\t') {
+            src++;
+        }
+        if (*src == '\0') {
+            return count;
+        }
+        if (count == max) {
+            return -1;
+        }
+        words[count++] = dst;
+
+        // The word is copied down over its own quotes and escapes.
+        char quote = 0;
+        while (*src != '\0' && (quote || (*src != ' ' && *src != '\t'))) {
+            if (quote && *src == quote) {
+                quote = 0;
+                src++;
+            } else if (!quote && (*src == '"' || *src == '\'')) {
+                quote = *src++;
+            } else if (*src == '\\' && quote != '\'' && src[1] != '\0') {
+                src++;
+                *dst++ = *src++;
+            } else {
+                *dst++ = *src++;
+            }
+        }
+        if (quote) {
+            return -1;
+        }
+        int end = *src == '\0';
+        *dst++ = '\0';
+        if (end) {
+            return count;
+        }
+        src++;
+    }
+}
+
+/**
+ * @brief Sets a flag of a query, rejecting it the second time.
+ * @return 0 on success, -1 if it was already set.
+ */
+static int query_flag(struct query *q, const char *path, uint8_t flag, const char *name)
+{
+    if (q->options & flag) {
+        fprintf(stderr, "ERROR: %s:%zu: You can only employ a flag once (%s)\n", path, q->line, name);
+        return -1;
+    }
+    q->options |= flag;
+    return 0;
+}
+
+/**
+ * @brief Applies an option that takes a value (-r or -s).
+ * @return 0 on success, -1 on error.
+ */
+static int query_value(struct query *q, const char *path, char option, const char *value)
+{
+    if (value == NULL) {
+        fprintf(stderr, "ERROR: %s:%zu: -%c needs a value\n", path, q->line, option);
+        return -1;
+    }
+    if (option == 'r') {
+        if (query_flag(q, path, OPTION_RANGE, "--range") < 0) {
+            return -1;
+        }
+        if (parse_range_list(value, &q->ranges) < 0) {
+            fprintf(stderr, "ERROR: %s:%zu: Invalid range format. Please use NUM-NUM, NUM or NUM-, separated by commas.\n",
+                    path, q->line);
+            return -1;
+        }
+        if (q->ranges.tail > 0) {
+            fprintf(stderr, "ERROR: %s:%zu: Tail ranges (-NUM-) cannot be used in a query.\n", path, q->line);
+            return -1;
+        }
+        return 0;
+    }
+    if (query_flag(q, path, OPTION_SAVE, "--save") < 0) {
+        return -1;
+    }
+    q->save_path = strdup(value);
+    if (q->save_path == NULL) {
+        fprintf(stderr, "search: Out of memory.\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Parses the words of one query line.
+ * @return 0 on success, -1 on error.
+ */
+static int query_parse(struct query *q, const char *path, char **words, int count)
+{
+    static const struct {
+        const char *name;
+        char option;
+    } long_options[] = {
+        {"ignore-case", 'i'}, {"isolate", 'I'}, {"lines", 'l'},
+        {"remove-dupes", 'R'}, {"range", 'r'}, {"save", 's'},
+    };
+    int options_done = 0;
+
+    for (int i = 0; i < count; i++) {
+        char *word = words[i];
+        if (options_done || word[0] != '-' || word[1] == '\0') {
+            if (q->term != NULL) {
+                fprintf(stderr, "ERROR: %s:%zu: A query has a single TERM (quote it to keep spaces)\n",
+                        path, q->line);
+                return -1;
+            }
+            q->term = strdup(word);
+            if (q->term == NULL) {
+                fprintf(stderr, "search: Out of memory.\n");
+                return -1;
+            }
+            continue;
+        }
+        if (strcmp(word, "--") == 0) {
+            options_done = 1;
+            continue;
+        }
+
+        // A long option is turned into its short letter; a value follows '=' or is the next word.
+        char letters[2] = {0};
+        char *attached = NULL;
+        if (word[1] == '-') {
+            char *eq = strchr(word + 2, '=');
+            size_t len = eq != NULL ? (size_t)(eq - word - 2) : strlen(word + 2);
+            for (size_t k = 0; k < sizeof(long_options) / sizeof(long_options[0]); k++) {
+                if (strlen(long_options[k].name) == len && strncmp(word + 2, long_options[k].name, len) == 0) {
+                    letters[0] = long_options[k].option;
+                }
+            }
+            if (letters[0] == '\0') {
+                fprintf(stderr, "ERROR: %s:%zu: Unknown option %s\n", path, q->line, word);
+                return -1;
+            }
+            attached = eq != NULL ? eq + 1 : NULL;
+            word = letters;
+        } else {
+            word++;
+        }
+
+        for (char *c = word; *c != '\0'; c++) {
+            int rc;
+            switch (*c) {
+                case 'i':
+                    rc = query_flag(q, path, OPTION_IGNORE, "--ignore-case");
+                    break;
+                case 'I':
+                    rc = query_flag(q, path, OPTION_ISOLATE, "--isolate");
+                    break;
+                case 'l':
+                    rc = query_flag(q, path, OPTION_LINES, "--lines");
+                    break;
+                case 'R':
+                    rc = query_flag(q, path, OPTION_REMOVE, "--remove-dupes");
+                    break;
+                case 'r':
+                case 's': {
+                    // The value is the rest of the word (-r10-20), after '=', or the next word.
+                    const char *value = attached != NULL ? attached : c[1] != '\0' ? c + 1 : NULL;
+                    if (value == NULL && i + 1 < count) {
+                        value = words[++i];
+                    }
+                    rc = query_value(q, path, *c, value);
+                    c += strlen(c) - 1; // The value ends the word
+                    break;
+                }
+                default:
+                    fprintf(stderr, "ERROR: %s:%zu: Unknown option -%c\n", path, q->line, *c);
+                    rc = -1;
+                    break;
+            }
+            if (rc < 0) {
+                return -1;
+            }
+        }
+    }
+
+    if (q->term == NULL || q->term[0] == '\0') {
+        fprintf(stderr, "ERROR: %s:%zu: The query has no TERM\n", path, q->line);
+        return -1;
+    }
+    return 0;
+}
+
+int query_load(const char *path, struct query_set *set)
+{
+    set->items = NULL;
+    set->count = 0;
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "search: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    size_t lineno = 0;
+    size_t items_cap = 0;
+    int rc = 0;
+    while (rc == 0 && getline(&line, &cap, f) >= 0) {
+        lineno++;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        // Only an unquoted, unescaped '#' starts a comment: "#include" is a term.
+        if (line[strspn(line, " \t")] == '#') {
+            continue;
+        }
+
+        char *words[QUERY_MAX_TOKENS];
+        int count = query_split(line, words, QUERY_MAX_TOKENS);
+        if (count < 0) {
+            fprintf(stderr, "ERROR: %s:%zu: Unterminated quote or too many words\n", path, lineno);
+            rc = -1;
+            break;
+        }
+        if (count == 0) {
+            continue;
+        }
+
+        if (set->count == items_cap) {
+            size_t grown_cap = items_cap ? items_cap * 2 : 16;
+            struct query *grown = realloc(set->items, grown_cap * sizeof(*grown));
+            if (grown == NULL) {
+                fprintf(stderr, "search: Out of memory.\n");
+                rc = -1;
+                break;
+            }
+            set->items = grown;
+            items_cap = grown_cap;
+        }
+        struct query *q = &set->items[set->count++];
+        memset(q, 0, sizeof(*q));
+        q->line = lineno;
+        rc = query_parse(q, path, words, count);
+    }
+    if (rc == 0 && ferror(f)) {
+        fprintf(stderr, "search: %s: Error while reading.\n", path);
+        rc = -1;
+    }
+    free(line);
+    fclose(f);
+
+    // Two queries saving to one file would overwrite each other.
+    for (size_t i = 0; rc == 0 && i < set->count; i++) {
+        for (size_t j = 0; j < i && set->items[i].save_path != NULL; j++) {
+            if (set->items[j].save_path != NULL && strcmp(set->items[i].save_path, set->items[j].save_path) == 0) {
+                fprintf(stderr, "ERROR: %s:%zu: %s is already the save file of line %zu\n", path,
+                        set->items[i].line, set->items[i].save_path, set->items[j].line);
+                rc = -1;
+                break;
+            }
+        }
+    }
+    if (rc == 0 && set->count == 0) {
+        fprintf(stderr, "ERROR: %s has no queries.\n", path);
+        rc = -1;
+    }
+    if (rc < 0) {
+        query_free(set);
+    }
+    return rc;
+}
+
+int query_open(struct query_set *set, FILE *dest, const char *name, int binary)
+{
+    int first_shared = 1;
+
+    for (size_t i = 0; i < set->count; i++) {
+        struct query *q = &set->items[i];
+        // Sized from the name, so a long path never cuts off the query number.
+        int len;
+        if (binary && q->save_path != NULL) {
+            len = asprintf(&q->tag, "%s", name);
+        } else if (binary) {
+            len = asprintf(&q->tag, "%s (QUERY %zu)", name, i + 1);
+        } else {
+            len = asprintf(&q->tag, "QUERY %zu", i + 1);
+        }
+        if (len < 0) {
+            q->tag = NULL;
+            fprintf(stderr, "search: Out of memory.\n");
+            return -1;
+        }
+
+        // The first query without -s writes straight to the destination;
+        // later ones are held in temporary files until it is their turn.
+        if (q->save_path != NULL) {
+            q->stream = fopen(q->save_path, "w");
+        } else if (first_shared) {
+            q->stream = dest;
+            q->direct = 1;
+            first_shared = 0;
+        } else {
+            q->stream = tmpfile();
+        }
+        if (q->stream == NULL) {
+            fprintf(stderr, "search: %s: %s\n", q->save_path != NULL ? q->save_path : "temporary file",
+                    strerror(errno));
+            return -1;
+        }
+        if (output_init(&q->out, q->stream) < 0) {
+            fprintf(stderr, "search: Out of memory.\n");
+            return -1;
+        }
+
+        q->ctx = (struct search_ctx){
+            .term = q->term,
+            .term_len = strlen(q->term),
+            .options = q->options,
+            .ranges = q->ranges.items,
+            .range_count = q->ranges.count,
+            .out = &q->out,
+            .name = q->tag,
+            .show_name = q->save_path == NULL,
+            .binary = binary,
+        };
+    }
+    return 0;
+}
+
+/**
+ * @brief Pushes out every query's results before the reader waits for input.
+ */
+static void query_wait(void *arg)
+{
+    struct query_set *set = arg;
+    for (size_t i = 0; i < set->count; i++) {
+        output_flush(&set->items[i].out);
+    }
+}
+
+int query_scan(struct query_set *set, struct reader *reader)
+{
+    // The queries that may still print, in no particular order.
+    struct query **active = malloc(set->count * sizeof(*active));
+    if (active == NULL) {
+        fprintf(stderr, "search: Out of memory.\n");
+        return -1;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < set->count; i++) {
+        if (search_next_in_range(&set->items[i].ctx, 1) != 0) {
+            active[count++] = &set->items[i];
+        }
+    }
+
+    uint64_t linecount = 1;
+    int readstatus = 0;
+    reader->wait = query_wait;
+    reader->wait_arg = set;
+    while (count > 0) {
+        // 1. Skip the lines that no query wants
+        uint64_t nextline = UINT64_MAX;
+        for (size_t i = 0; i < count; i++) {
+            uint64_t next = search_next_in_range(&active[i]->ctx, linecount);
+            if (next < nextline) {
+                nextline = next;
+            }
+        }
+        if (nextline > linecount) {
+            uint64_t skipped;
+            readstatus = reader_skip_lines(reader, nextline - linecount, &skipped);
+            linecount += skipped;
+            if (readstatus < 0 || linecount < nextline) {
+                break; // Input ended inside the gap
+            }
+        }
+
+        const char *line;
+        size_t len;
+        if ((readstatus = reader_next_line(reader, &line, &len)) <= 0) {
+            break;
+        }
+
+        // 2. Hand the line to every query, dropping those that are finished
+        for (size_t i = 0; i < count;) {
+            struct query *q = active[i];
+            if (search_in_range(&q->ctx, linecount)) {
+                search_emit_line(&q->ctx, linecount, line, len, reader->line_stable);
+            }
+            if (q->ctx.done || search_next_in_range(&q->ctx, linecount + 1) == 0) {
+                active[i] = active[--count];
+            } else {
+                i++;
+            }
+        }
+        linecount++;
+    }
+
+    reader->wait = NULL;
+    free(active);
+    return readstatus < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Appends a temporary file's contents to the destination.
+ * @return 0 on success, -1 on error.
+ */
+static int query_append(FILE *from, struct output *dest)
+{
+    int fd = fileno(from);
+    if (lseek(fd, 0, SEEK_SET) < 0) {
+        return -1;
+    }
+    for (;;) {
+        char *buf = output_reserve(dest, OUTPUT_BUFFER_SIZE);
+        if (buf == NULL) {
+            return -1;
+        }
+        ssize_t n = read(fd, buf, OUTPUT_BUFFER_SIZE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return n < 0 ? -1 : 0;
+        }
+        if (output_commit(dest, (size_t)n) < 0) {
+            return -1;
+        }
+    }
+}
+
+int query_finish(struct query_set *set, FILE *dest)
+{
+    int rc = 0;
+    struct output out;
+    if (output_init(&out, dest) < 0) {
+        fprintf(stderr, "search: Out of memory.\n");
+        return -1;
+    }
+
+    for (size_t i = 0; i < set->count; i++) {
+        struct query *q = &set->items[i];
+        if (q->stream == NULL) {
+            continue;
+        }
+        if (output_close(&q->out) < 0) {
+            rc = -1;
+        }
+        if (q->direct) {
+            // Written in place; nothing to append.
+        } else if (q->save_path == NULL) {
+            if (query_append(q->stream, &out) < 0) {
+                rc = -1;
+            }
+            fclose(q->stream);
+        } else if (fclose(q->stream) != 0) {
+            rc = -1;
+        }
+        q->stream = NULL;
+    }
+
+    if (output_close(&out) < 0) {
+        rc = -1;
+    }
+    return rc;
+}
+
+void query_free(struct query_set *set)
+{
+    for (size_t i = 0; i < set->count; i++) {
+        struct query *q = &set->items[i];
+        if (q->stream != NULL) {
+            // Still open after an error; the shared destination belongs to the caller.
+            free(q->out.buf);
+            if (!q->direct) {
+                fclose(q->stream);
+            }
+        }
+        free(q->term);
+        free(q->save_path);
+        free(q->tag);
+        range_list_free(&q->ranges);
+    }
+    free(set->items);
+    set->items = NULL;
+    set->count = 0;
+}
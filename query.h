@@ -0,0 +1,95 @@
+/**
+ * @file query.h
+ * @brief Many searches over one input in a single shared scan (--queries).
+ *
+ * Each non-empty line of a queries file is one query: a TERM with its own
+ * -i, -I, -l, -R, -r RANGE and -s FILE options, e.g.
+ *
+ *     -i -r 1-5000 timeout
+ *     -I -s errors.txt "disk full"
+ *
+ * Lines whose first non-blank character is '#' are comments; single or
+ * double quotes keep spaces in a term, and a quoted or escaped '#' starts
+ * one. The input is read once, and every line is handed to each query still
+ * in range, so a decompressed or piped input costs one pass however many
+ * queries there are. A query with -s writes its results to that file;
+ * the others are tagged "QUERY n: " and written to the shared destination,
+ * grouped in query order.
+ */
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "output.h"
+#include "range.h"
+#include "reader.h"
+#include "search.h"
+
+#define QUERY_MAX_TOKENS 64     // Words on one query line
+
+struct query {
+    char *term;
+    uint8_t options;            // OPTION_IGNORE, ISOLATE, LINES, REMOVE, RANGE and SAVE
+    struct range_list ranges;
+    char *save_path;            // -s FILE, or NULL to write to the shared destination
+    size_t line;                // Line of the queries file
+    char *tag;                  // "QUERY n"; for binary input, the input's name (with "QUERY n" if shared)
+    FILE *stream;               // Save file, a temporary file for grouped output, or the destination
+    int direct;                 // stream is the shared destination
+    struct output out;
+    struct search_ctx ctx;
+};
+
+struct query_set {
+    struct query *items;
+    size_t count;
+};
+
+/**
+ * @brief Reads and parses a queries file; problems are reported with their line.
+ *
+ * @param path The queries file.
+ * @param set Receives the queries.
+ * @return 0 on success, -1 on a malformed query, an unreadable file or if out of memory.
+ */
+int query_load(const char *path, struct query_set *set);
+
+/**
+ * @brief Opens every query's output and prepares its search context.
+ *
+ * @param set The queries.
+ * @param dest The shared destination for queries without -s.
+ * @param name The input name (used for binary input).
+ * @param binary Non-zero if the input is binary and only a first hit is reported.
+ * @return 0 on success, -1 if a save file cannot be opened or out of memory.
+ */
+int query_open(struct query_set *set, FILE *dest, const char *name, int binary);
+
+/**
+ * @brief Reads the input once, printing each query's results.
+ *
+ * Lines that no query's range wants are skipped in bulk, and reading stops
+ * once every query is past its last range.
+ *
+ * @return 0 on success, -1 on a read error.
+ */
+int query_scan(struct query_set *set, struct reader *reader);
+
+/**
+ * @brief Flushes every query's output, appends the grouped results to the
+ * destination in query order and closes the save files.
+ *
+ * @param set The queries.
+ * @param dest The shared destination (not closed).
+ * @return 0 on success, -1 on write error.
+ */
+int query_finish(struct query_set *set, FILE *dest);
+
+/**
+ * @brief Releases the queries (closing any output still open).
+ */
+void query_free(struct query_set *set);
+
+#endif // QUERY_H
@@ -4,44 +4,84 @@
  */
 
 #include "range.h"
+#include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 
 /**
- * @brief Safely extracts and converts a numeric range part.
+ * @brief Returns the multiplier for a size suffix (K, M, G, T; add B for powers of 1000).
+ *
+ * @param suffix The suffix string (possibly empty).
+ * @return The multiplier, or 0 if the suffix is not recognised.
+ */
+static int64_t range_suffix_multiplier(const char *suffix)
+{
+    static const char units[] = "KMGT";
+    const char *unit;
+
+    if (*suffix == '\0') {
+        return 1;
+    }
+    unit = strchr(units, toupper((unsigned char)*suffix));
+    if (unit == NULL) {
+        return 0;
+    }
+
+    // Like coreutils: 10M is 10 * 1024^2, 10MB is 10 * 1000^2.
+    int64_t base = 1024;
+    if (suffix[1] == 'B' || suffix[1] == 'b') {
+        base = 1000;
+        suffix++;
+    }
+    if (suffix[1] != '\0') {
+        return 0;
+    }
+
+    int64_t multiplier = 1;
+    for (const char *u = units; u <= unit; u++) {
+        multiplier *= base;
+    }
+    return multiplier;
+}
+
+/**
+ * @brief Safely extracts and converts a numeric range part, with an optional size suffix.
  *
  * @param start The pointer to the start of the number string.
  * @param end The pointer to the end of the number string (or NULL if to end of string).
- * @return The converted integer value, or -1 on failure.
+ * @return The converted value, or -1 on failure.
  */
-static int safe_strtol_extract(const char *start, const char *end)
+static int64_t safe_strtol_extract(const char *start, const char *end)
 {
-    // Copy a safe segment into a temporary buffer for strtol.
-    // The longest 32-bit int is 10 digits + sign + null terminator. 16 is plenty.
-    char temp_buffer[16]; 
+    // Copy a safe segment into a temporary buffer for strtoll.
+    // The longest 64-bit value is 19 digits; leave room for a suffix and the null terminator.
+    char temp_buffer[32];
     size_t len = (end == NULL) ? strlen(start) : (size_t)(end - start);
 
-    if (len == 0 || len >= sizeof(temp_buffer) || len > 10) {
-        return -1; // Invalid length
+    if (len == 0 || len >= sizeof(temp_buffer) || !isdigit((unsigned char)*start)) {
+        return -1; // Invalid length, or a sign strtoll would accept
     }
     
     // Copy the segment and null-terminate it
-    strncpy(temp_buffer, start, len);
+    memcpy(temp_buffer, start, len);
     temp_buffer[len] = '\0';
 
     char *endptr;
-    // Use strtol for safe conversion and error checking
-    long val = strtol(temp_buffer, &endptr, 10);
+    // Use strtoll for safe conversion and error checking
+    errno = 0;
+    long long val = strtoll(temp_buffer, &endptr, 10);
+    int64_t multiplier = range_suffix_multiplier(endptr);
 
-    // Check if the entire string was consumed and the result is within int bounds
-    if (*endptr != '\0' || endptr == temp_buffer || val > INT_MAX || val < 0) {
-        return -1; // Conversion error or negative value
+    // Check for overflow and that only a known suffix follows the digits
+    if (errno == ERANGE || endptr == temp_buffer || multiplier == 0 || val > INT64_MAX / multiplier) {
+        return -1;
     }
 
-    return (int)val;
+    return (int64_t)val * multiplier;
 }
 
-int get_low_range(const char *arg)
+int64_t get_low_range(const char *arg)
 {
     const char *delimiter = strchr(arg, '-');
     if (delimiter == NULL) {
@@ -53,7 +93,7 @@ int get_low_range(const char *arg)
     return safe_strtol_extract(arg, delimiter);
 }
 
-int get_high_range(const char *arg)
+int64_t get_high_range(const char *arg)
 {
     const char *delimiter = strchr(arg, '-');
     if (delimiter == NULL) {
@@ -64,3 +104,159 @@ int get_high_range(const char *arg)
     // The high value starts right after the hyphen
     return safe_strtol_extract(delimiter + 1, NULL);
 }
+
+/**
+ * @brief Orders ranges by their lower bound (for qsort).
+ */
+static int range_compare(const void *a, const void *b)
+{
+    const struct line_range *ra = a, *rb = b;
+    return (ra->low > rb->low) - (ra->low < rb->low);
+}
+
+/**
+ * @brief Sorts a list by lower bound, then merges ranges that overlap or touch.
+ */
+static void range_list_normalize(struct range_list *list)
+{
+    if (list->count == 0) {
+        return;
+    }
+
+    qsort(list->items, list->count, sizeof(*list->items), range_compare);
+    size_t merged = 0;
+    for (size_t i = 1; i < list->count; i++) {
+        struct line_range *last = &list->items[merged];
+        if (last->high == RANGE_OPEN_END || list->items[i].low <= last->high + 1) {
+            if (list->items[i].high > last->high) {
+                last->high = list->items[i].high;
+            }
+        } else {
+            list->items[++merged] = list->items[i];
+        }
+    }
+    list->count = merged + 1;
+}
+
+int parse_range_list(const char *arg, struct range_list *list)
+{
+    list->items = NULL;
+    list->count = 0;
+    list->tail = 0;
+
+    // Every part needs at least one digit, so there are at most strlen / 2 + 1 parts.
+    size_t cap = strlen(arg) / 2 + 1;
+    list->items = malloc(cap * sizeof(*list->items));
+    if (list->items == NULL) {
+        return -1;
+    }
+
+    for (const char *part = arg; part != NULL; ) {
+        const char *comma = strchr(part, ',');
+        size_t len = (comma == NULL) ? strlen(part) : (size_t)(comma - part);
+        char temp_buffer[48];
+        int64_t low, high;
+        int open_end = 0;
+
+        if (len == 0 || len >= sizeof(temp_buffer) || list->count == cap) {
+            range_list_free(list);
+            return -1;
+        }
+        memcpy(temp_buffer, part, len);
+        temp_buffer[len] = '\0';
+        part = (comma == NULL) ? NULL : comma + 1;
+
+        if (temp_buffer[0] == '-') {
+            // Tail: the last NUM lines, written -NUM- (or just -NUM)
+            if (len > 1 && temp_buffer[len - 1] == '-') {
+                temp_buffer[len - 1] = '\0';
+            }
+            int64_t tail = safe_strtol_extract(temp_buffer + 1, NULL);
+            if (tail <= 0) {
+                range_list_free(list);
+                return -1;
+            }
+            if ((uint64_t)tail > list->tail) {
+                list->tail = (uint64_t)tail;
+            }
+            continue;
+        }
+
+        if (temp_buffer[len - 1] == '-') {
+            // Open-ended: everything from the lower bound onwards
+            temp_buffer[len - 1] = '\0';
+            low = safe_strtol_extract(temp_buffer, NULL);
+            high = low;
+            open_end = 1;
+        } else {
+            low = get_low_range(temp_buffer);
+            high = get_high_range(temp_buffer);
+        }
+        if (low < 0 || high < 0) {
+            range_list_free(list);
+            return -1;
+        }
+
+        // Sort the range values
+        if (high < low) {
+            int64_t holder = high;
+            high = low;
+            low = holder;
+        }
+        list->items[list->count].low = (uint64_t)low;
+        list->items[list->count].high = open_end ? RANGE_OPEN_END : (uint64_t)high;
+        list->count++;
+    }
+
+    range_list_normalize(list);
+    return 0;
+}
+
+int range_list_add(struct range_list *list, uint64_t low, uint64_t high)
+{
+    struct line_range *grown = realloc(list->items, (list->count + 1) * sizeof(*grown));
+    if (grown == NULL) {
+        return -1;
+    }
+    list->items = grown;
+    list->items[list->count].low = low;
+    list->items[list->count].high = high;
+    list->count++;
+    range_list_normalize(list);
+    return 0;
+}
+
+int parse_byte_range(const char *arg, uint64_t *start, uint64_t *end)
+{
+    const char *delimiter = strchr(arg, '-');
+    int64_t low, high;
+
+    if (delimiter == NULL || (low = safe_strtol_extract(arg, delimiter)) < 0) {
+        return -1;
+    }
+    *start = (uint64_t)low;
+    if (delimiter[1] == '\0') {
+        *end = UINT64_MAX; // Open-ended: to the end of the input
+        return 0;
+    }
+    if ((high = safe_strtol_extract(delimiter + 1, NULL)) < 0) {
+        return -1;
+    }
+    *end = (uint64_t)high;
+
+    // Sort the range values
+    if (*end < *start) {
+        uint64_t holder = *end;
+        *end = *start;
+        *start = holder;
+    }
+    return 0;
+}
+
+void range_list_free(struct range_list *list)
+{
+    free(list->items);
+    list->items = NULL;
+    list->count = 0;
+    list->tail = 0;
+}
@@ -6,22 +6,81 @@
 #define RANGE_H
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <limits.h>
 
+#define RANGE_OPEN_END UINT64_MAX // Upper bound of an open-ended range such as "90000-"
+
+/**
+ * @brief An inclusive range of line numbers.
+ */
+struct line_range {
+    uint64_t low;
+    uint64_t high;
+};
+
+/**
+ * @brief A sorted list of disjoint, non-adjacent line ranges.
+ */
+struct range_list {
+    struct line_range *items;
+    size_t count;
+    uint64_t tail;          // Also the last `tail` lines of the input (-N-), 0 if none
+};
+
 /**
  * @brief Parses the left (lower) value from a range string (e.g., "50-75").
  *
+ * Values may carry a size suffix: K, M, G or T for powers of 1024, KB, MB,
+ * GB or TB for powers of 1000 (e.g., "10M-12M").
+ *
  * @param args The range string.
- * @return The integer value of the left side, or -1 on error.
+ * @return The value of the left side, or -1 on error.
  */
-int get_low_range(const char *arg);
+int64_t get_low_range(const char *arg);
 
 /**
  * @brief Parses the right (upper) value from a range string (e.g., "50-75").
  *
  * @param args The range string.
- * @return The integer value of the right side, or -1 on error.
+ * @return The value of the right side, or -1 on error.
+ */
+int64_t get_high_range(const char *arg);
+
+/**
+ * @brief Parses a comma-separated list of ranges (e.g., "1-10,500-600,90000-").
+ *
+ * Each part is NUM-NUM (either order), a single NUM, NUM- for everything
+ * from NUM onwards, or -NUM- for the last NUM lines. The result is sorted
+ * and overlapping or adjacent ranges are merged. Tail parts are kept aside
+ * in list->tail until the input's length is known (see range_list_add).
+ *
+ * @param arg The range list string.
+ * @param list Receives the ranges.
+ * @return 0 on success, -1 on a malformed list or if out of memory.
+ */
+int parse_range_list(const char *arg, struct range_list *list);
+
+/**
+ * @brief Adds a range to a list, keeping it sorted and merged.
+ *
+ * @return 0 on success, -1 if out of memory.
+ */
+int range_list_add(struct range_list *list, uint64_t low, uint64_t high);
+
+/**
+ * @brief Parses a byte range (e.g., "1048576-2097152", or "1048576-" to the end).
+ *
+ * @param arg The byte range string.
+ * @param start Receives the first byte offset.
+ * @param end Receives the end offset (exclusive), or UINT64_MAX if open-ended.
+ * @return 0 on success, -1 on a malformed range.
+ */
+int parse_byte_range(const char *arg, uint64_t *start, uint64_t *end);
+
+/**
+ * @brief Releases the ranges of a list.
  */
-int get_high_range(const char *arg);
+void range_list_free(struct range_list *list);
 
 #endif // RANGE_H
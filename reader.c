@@ -0,0 +1,484 @@
+/**
+ * @file reader.c
+ * @brief Implementation of the block-based line reader.
+ */
+
+#include "reader.h"
+#include "memscan.h"
+#include "hugepage.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Maps a regular file, starting at the descriptor's current offset.
+ *
+ * Starting at the current offset keeps `search TERM < file` correct when the
+ * shell (or a previous reader of the descriptor) has already consumed a part.
+ *
+ * @return 0 on success, -1 if the file should be read as a stream instead.
+ */
+static int reader_map(struct reader *r, const struct stat *st)
+{
+    off_t offset = lseek(r->fd, 0, SEEK_CUR);
+    if (offset < 0 || offset > st->st_size) {
+        return -1;
+    }
+
+    r->mapped = 1;
+    r->eof = 1;
+    if (st->st_size == 0) {
+        return 0; // Nothing to map; mmap rejects zero-length mappings
+    }
+
+    void *map = mmap(NULL, (size_t)st->st_size, PROT_READ, MAP_PRIVATE, r->fd, 0);
+    if (map == MAP_FAILED) {
+        r->mapped = 0;
+        r->eof = 0;
+        return -1;
+    }
+    madvise(map, (size_t)st->st_size, MADV_SEQUENTIAL);
+    hugepage_advise(map, (size_t)st->st_size);
+
+    r->map = map;
+    r->map_len = (size_t)st->st_size;
+    r->block = r->map + offset;
+    r->block_len = r->map_len - (size_t)offset;
+    return 0;
+}
+
+/**
+ * @brief Reads the first block of a stream, so its magic bytes can be checked.
+ *
+ * Short reads are retried until a few bytes are available, because a pipe may
+ * deliver its first write in pieces.
+ */
+static int reader_prime(struct reader *r)
+{
+    size_t have = 0;
+
+    while (have < 4) {
+        ssize_t n = read(r->fd, r->buf + have, r->buf_cap - have);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            r->eof = 1;
+            break;
+        }
+        have += (size_t)n;
+    }
+
+    r->block = r->buf;
+    r->block_len = have;
+    r->pos = 0;
+    return 0;
+}
+
+/**
+ * @brief Switches the reader to a background decoder if the current block
+ * starts with the magic bytes of a compressed format.
+ *
+ * Mapped input hands the whole mapping to the decoder. Streams hand over the
+ * primed block, after which the decoder keeps reading the descriptor itself.
+ * Mapped input with more than one independent frame gets no decoder; its
+ * frames are left in r->frames for parallel decoding.
+ *
+ * @param path The input path, used to look for sidecar indexes (may be NULL).
+ */
+static int reader_detect(struct reader *r, const char *path)
+{
+    r->format = decoder_detect(r->block, r->block_len);
+    if (r->format == DECODER_NONE) {
+        return 0;
+    }
+    if (!decoder_supported(r->format)) {
+        errno = ENOTSUP; // Rather than searching the compressed bytes as binary
+        return -1;
+    }
+
+    if (r->mapped && decoder_split_frames(r->format, r->block, r->block_len, path,
+                                          &r->frames, &r->frame_count) == 0) {
+        if (r->frame_count > 1) {
+            r->mapped = 0;
+            r->block = NULL;
+            r->block_len = 0;
+            return 0; // eof stays set: there are no lines to read serially
+        }
+        free(r->frames);
+        r->frames = NULL;
+        r->frame_count = 0;
+    }
+
+    int fd = (r->mapped || r->eof) ? -1 : r->fd;
+    r->decoder = decoder_start(r->format, fd, r->block, r->block_len);
+    if (r->decoder == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    r->mapped = 0; // Lines now live in decoder blocks that get recycled
+    r->block = NULL;
+    r->block_len = 0;
+    r->pos = 0;
+    r->eof = 0;
+    return 0;
+}
+
+/**
+ * @brief Maps or primes the input and detects its format.
+ */
+static int reader_setup(struct reader *r, const char *path)
+{
+    struct stat st;
+    if (fstat(r->fd, &st) == 0 && S_ISREG(st.st_mode) && reader_map(r, &st) == 0) {
+        // Sidecar indexes can only be found for named files mapped from offset 0.
+        const char *sidecar_base = r->block == r->map ? path : NULL;
+        if (reader_detect(r, sidecar_base) < 0) {
+            int saved = errno;
+            reader_close(r);
+            errno = saved;
+            return -1;
+        }
+        return 0;
+    }
+
+    // Pipes, terminals, sockets and unmappable files are read in blocks.
+    r->buf_cap = READER_BLOCK_SIZE;
+    r->buf = hugepage_alloc(r->buf_cap);
+    if (r->buf == NULL || reader_prime(r) < 0 || reader_detect(r, NULL) < 0) {
+        int saved = errno;
+        reader_close(r);
+        errno = saved;
+        return -1;
+    }
+    return 0;
+}
+
+int reader_open(struct reader *r, const char *path)
+{
+    if (path == NULL || strcmp(path, "-") == 0) {
+        memset(r, 0, sizeof(*r));
+        r->fd = STDIN_FILENO;
+        return reader_setup(r, NULL);
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    return reader_open_fd(r, fd, path);
+}
+
+int reader_open_fd(struct reader *r, int fd, const char *path)
+{
+    memset(r, 0, sizeof(*r));
+    r->fd = fd;
+    r->owns_fd = 1;
+    return reader_setup(r, path);
+}
+
+const char *reader_strerror(int err)
+{
+    return err == ENOTSUP ? "built without zstd support (rebuild with ZSTD=1)" : strerror(err);
+}
+
+/**
+ * @brief Reads the next block of a stream into r->buf, or takes the next
+ * decompressed block from the decoder.
+ * @return 1 if a block was read, 0 at end of input, -1 on error.
+ */
+static int reader_fill(struct reader *r)
+{
+    if (r->eof) {
+        return 0;
+    }
+
+    // The next block may be a while coming (a live pipe, a slow decoder).
+    if (r->wait != NULL) {
+        r->wait(r->wait_arg);
+    }
+
+    // The block being replaced has been consumed.
+    r->block_base += r->block_len;
+
+    if (r->decoder != NULL) {
+        int rc = decoder_next_block(r->decoder, &r->block, &r->block_len);
+        if (rc <= 0) {
+            r->block_len = 0; // The last block went back to the decoder
+            r->eof = (rc == 0);
+        }
+        r->pos = 0;
+        return rc;
+    }
+
+    ssize_t n;
+    do {
+        n = read(r->fd, r->buf, r->buf_cap);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        return -1;
+    }
+    if (n == 0) {
+        r->eof = 1;
+        return 0;
+    }
+
+    r->block = r->buf;
+    r->block_len = (size_t)n;
+    r->pos = 0;
+    return 1;
+}
+
+/**
+ * @brief Appends bytes to the spill buffer, growing it as needed.
+ */
+static int reader_spill(struct reader *r, const char *data, size_t len)
+{
+    if (r->spill_len + len > r->spill_cap) {
+        size_t cap = r->spill_cap ? r->spill_cap : 4096;
+        while (cap < r->spill_len + len) {
+            cap *= 2;
+        }
+        char *grown = realloc(r->spill, cap);
+        if (grown == NULL) {
+            return -1;
+        }
+        r->spill = grown;
+        r->spill_cap = cap;
+    }
+    memcpy(r->spill + r->spill_len, data, len);
+    r->spill_len += len;
+    return 0;
+}
+
+int reader_next_line(struct reader *r, const char **line, size_t *len)
+{
+    r->line_stable = 0;
+
+    // The previous call may have returned the spill buffer; it is consumed now.
+    if (r->spill_returned) {
+        r->spill_len = 0;
+        r->spill_returned = 0;
+    }
+
+    for (;;) {
+        const char *start = r->block + r->pos;
+        size_t avail = r->block_len - r->pos;
+        const char *nl = avail ? memchr(start, '\n', avail) : NULL;
+
+        if (nl != NULL) {
+            size_t n = (size_t)(nl - start) + 1;
+            r->pos += n;
+
+            if (r->spill_len == 0) {
+                *line = start;
+                *len = n;
+                r->line_offset = r->block_base + (uint64_t)(start - r->block);
+                r->line_stable = r->mapped;
+                return 1;
+            }
+
+            // Finish a line that began in an earlier block.
+            if (reader_spill(r, start, n) < 0) {
+                return -1;
+            }
+            *line = r->spill;
+            *len = r->spill_len;
+            r->line_offset = r->spill_offset;
+            r->spill_returned = 1;
+            return 1;
+        }
+
+        // Final line of a mapping without a trailing newline: hand it out in place.
+        if (avail && r->eof && r->spill_len == 0) {
+            r->pos = r->block_len;
+            *line = start;
+            *len = avail;
+            r->line_offset = r->block_base + (uint64_t)(start - r->block);
+            r->line_stable = r->mapped;
+            return 1;
+        }
+
+        // No newline left in this block: carry the partial line forward.
+        if (avail && r->spill_len == 0) {
+            r->spill_offset = r->block_base + (uint64_t)(start - r->block);
+        }
+        if (avail && reader_spill(r, start, avail) < 0) {
+            return -1;
+        }
+        r->pos = r->block_len;
+
+        int rc = reader_fill(r);
+        if (rc < 0) {
+            return -1;
+        }
+        if (rc == 0) {
+            if (r->spill_len == 0) {
+                return 0;
+            }
+            // Final line without a trailing newline.
+            *line = r->spill;
+            *len = r->spill_len;
+            r->line_offset = r->spill_offset;
+            r->spill_returned = 1;
+            return 1;
+        }
+        // A fresh block starts at pos 0 with the spill still pending.
+    }
+}
+
+int reader_next_block(struct reader *r, const char **data, size_t *len)
+{
+    if (r->spill_returned) {
+        r->spill_len = 0;
+        r->spill_returned = 0;
+    }
+    if (r->spill_len > 0) {
+        *data = r->spill;
+        *len = r->spill_len;
+        r->spill_returned = 1;
+        return 1;
+    }
+
+    while (r->pos == r->block_len) {
+        int rc = reader_fill(r);
+        if (rc <= 0) {
+            return rc;
+        }
+    }
+    *data = r->block + r->pos;
+    *len = r->block_len - r->pos;
+    r->pos = r->block_len;
+    return 1;
+}
+
+int reader_seek(struct reader *r, uint64_t offset)
+{
+    // Streams and decoders can only be read through.
+    if (!r->mapped || r->pos != 0 || r->spill_len != 0 || offset > r->block_len) {
+        return -1;
+    }
+    r->pos = (size_t)offset;
+    return 0;
+}
+
+int reader_skip_lines(struct reader *r, uint64_t count, uint64_t *skipped)
+{
+    uint64_t left = count;
+
+    if (r->spill_returned) {
+        r->spill_len = 0;
+        r->spill_returned = 0;
+    }
+    *skipped = 0;
+    if (count == 0) {
+        return 0;
+    }
+
+    // The partial line carried over (if any) is the first one skipped.
+    r->spill_len = 0;
+
+    for (;;) {
+        r->pos += memscan_skip_lines(r->block + r->pos, r->block_len - r->pos, &left);
+        if (left == 0) {
+            break;
+        }
+
+        int rc = reader_fill(r);
+        if (rc < 0) {
+            *skipped = count - left;
+            return -1;
+        }
+        if (rc == 0) {
+            break;
+        }
+    }
+
+    *skipped = count - left;
+    return 0;
+}
+
+int reader_skip_bytes(struct reader *r, uint64_t count, uint64_t *newlines)
+{
+    if (r->spill_returned) {
+        r->spill_len = 0;
+        r->spill_returned = 0;
+    }
+    if (newlines != NULL) {
+        *newlines = 0;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    // Whatever partial line was carried over is passed as well.
+    r->spill_len = 0;
+
+    for (;;) {
+        size_t avail = r->block_len - r->pos;
+        size_t n = count < avail ? (size_t)count : avail;
+
+        if (newlines != NULL) {
+            *newlines += memscan_count_newlines(r->block + r->pos, n);
+        }
+        r->pos += n;
+        count -= n;
+        if (count == 0) {
+            return 0;
+        }
+
+        int rc = reader_fill(r);
+        if (rc <= 0) {
+            return rc;
+        }
+    }
+}
+
+int reader_peek(struct reader *r, const char **data, size_t *len)
+{
+    if (r->frames != NULL) {
+        if (r->peek == NULL &&
+            decoder_decode_frame(r->format, &r->frames[0], &r->peek, &r->peek_len) < 0) {
+            return -1;
+        }
+        *data = r->peek;
+        *len = r->peek_len < READER_BLOCK_SIZE ? r->peek_len : READER_BLOCK_SIZE;
+        return 0;
+    }
+
+    // A decoder has not produced anything until the first block is requested.
+    if (r->decoder != NULL && r->block_len == 0 && !r->eof && reader_fill(r) < 0) {
+        return -1;
+    }
+
+    *data = r->block;
+    *len = r->block_len < READER_BLOCK_SIZE ? r->block_len : READER_BLOCK_SIZE;
+    return 0;
+}
+
+void reader_close(struct reader *r)
+{
+    decoder_stop(r->decoder);
+    if (r->map != NULL) {
+        munmap(r->map, r->map_len);
+    }
+    hugepage_free(r->buf, r->buf_cap);
+    free(r->spill);
+    free(r->frames);
+    free(r->peek);
+    if (r->owns_fd) {
+        close(r->fd);
+    }
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
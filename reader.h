@@ -0,0 +1,164 @@
+/**
+ * @file reader.h
+ * @brief Block-based line reader for files and standard input.
+ *
+ * Regular files (including a regular file redirected to stdin) are mapped
+ * into memory and served as a single block. Pipes and terminals are read in
+ * large blocks with read(2). Lines are handed out as pointer/length pairs
+ * into the current block, so no per-line copying takes place except for the
+ * rare line that straddles two blocks.
+ *
+ * Compressed input (detected from its magic bytes) is decompressed on a
+ * background thread and served block by block in the same way. A mapped
+ * input made of several independent frames is not read line by line at all;
+ * its frames are exposed for the parallel scanner instead.
+ */
+#ifndef READER_H
+#define READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decompress.h"
+
+#define READER_BLOCK_SIZE (1 << 20) // 1 MiB read(2) blocks for streams
+
+struct reader {
+    int fd;                 // Input descriptor
+    int owns_fd;            // Close fd in reader_close (not done for stdin)
+    int mapped;             // 1 when lines are served straight from an mmap of a regular file
+    char *map;              // Mapping base (page aligned)
+    size_t map_len;         // Mapping length
+
+    const char *block;      // Current block of input
+    size_t block_len;       // Bytes in the current block
+    size_t pos;             // Consume offset within the current block
+
+    char *buf;              // read(2) buffer for non-mapped input
+    size_t buf_cap;
+
+    enum decoder_format format; // Compression detected on the input
+    struct decoder *decoder;    // Background decompressor, or NULL for plain input
+    struct frame *frames;       // Independent frames of a mapped input, or NULL
+    size_t frame_count;
+    char *peek;                 // First frame decoded by reader_peek
+    size_t peek_len;
+
+    char *spill;            // Partial line carried across a block boundary
+    size_t spill_len;
+    size_t spill_cap;
+    int spill_returned;     // Spill was handed out and is dropped on the next call
+    uint64_t spill_offset;  // Input offset of the line in the spill buffer
+
+    uint64_t block_base;    // Input offset of the start of the current block
+    uint64_t line_offset;   // Input offset of the last line returned (from where reading began)
+
+    int eof;                // No more blocks will be produced
+    int line_stable;        // Last line points into the mapping and stays valid
+
+    void (*wait)(void *arg); // Called before reading the next block of a stream or decoder, or NULL
+    void *wait_arg;
+};
+
+/**
+ * @brief Opens an input for reading.
+ *
+ * @param r The reader to initialise.
+ * @param path The file path, or NULL / "-" for standard input.
+ * @return 0 on success, -1 on failure (errno is set; ENOTSUP for a compressed
+ * format this build cannot decompress).
+ */
+int reader_open(struct reader *r, const char *path);
+
+/**
+ * @brief Opens an input from a descriptor that is already open.
+ *
+ * @param r The reader to initialise.
+ * @param fd The descriptor; the reader takes it over and closes it.
+ * @param path The name it was opened under, used to find sidecar indexes (or NULL).
+ * @return 0 on success, -1 on failure (errno is set as for reader_open; fd is closed).
+ */
+int reader_open_fd(struct reader *r, int fd, const char *path);
+
+/**
+ * @brief Describes the errno of a failed reader_open.
+ */
+const char *reader_strerror(int err);
+
+/**
+ * @brief Returns the next line of input, including its trailing newline.
+ *
+ * The returned pointer is valid until the next call on the same reader.
+ * If r->line_stable is set afterwards, it stays valid until reader_close.
+ *
+ * @param r The reader.
+ * @param line Receives a pointer to the start of the line.
+ * @param len Receives the length of the line in bytes.
+ * @return 1 if a line was returned, 0 at end of input, -1 on read error.
+ */
+int reader_next_line(struct reader *r, const char **line, size_t *len);
+
+/**
+ * @brief Returns the rest of the input a block at a time, without splitting lines.
+ *
+ * A partial line left over from reader_next_line or reader_skip_lines comes
+ * first. The returned bytes are valid until the next call on the same reader.
+ *
+ * @param r The reader.
+ * @param data Receives the start of the block.
+ * @param len Receives the block length (never 0).
+ * @return 1 if a block was returned, 0 at end of input, -1 on read error.
+ */
+int reader_next_block(struct reader *r, const char **data, size_t *len);
+
+/**
+ * @brief Jumps to a byte offset of a mapped input before any line is read.
+ *
+ * @param r The reader.
+ * @param offset The offset from the start of the input; it must start a line.
+ * @return 0 on success, -1 if the input cannot jump (streams, decoders) or
+ * the offset lies past its end.
+ */
+int reader_seek(struct reader *r, uint64_t offset);
+
+/**
+ * @brief Skips lines without returning them, counting newlines over whole blocks.
+ *
+ * Used to reach the start of a --range without splitting every earlier line.
+ *
+ * @param r The reader.
+ * @param count The number of lines to skip.
+ * @param skipped Receives the number of lines skipped (less than count at end of input).
+ * @return 0 on success, -1 on a read error.
+ */
+int reader_skip_lines(struct reader *r, uint64_t count, uint64_t *skipped);
+
+/**
+ * @brief Skips bytes without returning them, optionally counting the newlines passed.
+ *
+ * @param r The reader.
+ * @param count The number of bytes to skip.
+ * @param newlines Receives the newlines in the skipped bytes (may be NULL).
+ * @return 0 on success (also when the input ends first), -1 on a read error.
+ */
+int reader_skip_bytes(struct reader *r, uint64_t count, uint64_t *newlines);
+
+/**
+ * @brief Returns the first block of (decompressed) input without consuming it.
+ *
+ * Must be called before the first reader_next_line. For framed input the
+ * first frame is decoded for the purpose.
+ *
+ * @param r The reader.
+ * @param data Receives the start of the block.
+ * @param len Receives the block length (at most READER_BLOCK_SIZE).
+ * @return 0 on success, -1 on a read or decoding error.
+ */
+int reader_peek(struct reader *r, const char **data, size_t *len);
+
+/**
+ * @brief Releases the mapping, buffers and (if owned) the descriptor.
+ */
+void reader_close(struct reader *r);
+
+#endif // READER_H
@@ -0,0 +1,96 @@
+/**
+ * @file ring.c
+ * @brief Implementation of the single-producer/single-consumer ring.
+ */
+
+#define _GNU_SOURCE
+#include "ring.h"
+
+#include <linux/futex.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+int ring_init(struct ring *r, uint32_t capacity)
+{
+    uint32_t cap = 1;
+    while (cap < capacity) {
+        cap <<= 1;
+    }
+    r->head = 0;
+    r->tail = 0;
+    r->sleeping = 0;
+    r->mask = cap - 1;
+    r->slots = calloc(cap, sizeof(*r->slots));
+    return r->slots != NULL ? 0 : -1;
+}
+
+/**
+ * @brief Waits until *word no longer holds seen.
+ *
+ * The sleeper announces itself before checking again, and the other side
+ * wakes it after moving its index, so a wakeup cannot be missed.
+ */
+static void ring_wait(struct ring *r, uint32_t *word, uint32_t seen)
+{
+    for (int i = 0; i < RING_SPIN; i++) {
+        if (__atomic_load_n(word, __ATOMIC_ACQUIRE) != seen) {
+            return;
+        }
+#ifdef __SSE2__
+        _mm_pause();
+#endif
+    }
+    while (__atomic_load_n(word, __ATOMIC_ACQUIRE) == seen) {
+        __atomic_store_n(&r->sleeping, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(word, __ATOMIC_SEQ_CST) != seen) {
+            break;
+        }
+        syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+    }
+}
+
+/**
+ * @brief Wakes the other side if it went to sleep on word.
+ */
+static void ring_wake(struct ring *r, uint32_t *word)
+{
+    if (__atomic_load_n(&r->sleeping, __ATOMIC_SEQ_CST) &&
+        __atomic_exchange_n(&r->sleeping, 0, __ATOMIC_SEQ_CST)) {
+        syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+void ring_push(struct ring *r, void *item)
+{
+    uint32_t tail = r->tail; // Only the producer writes it
+    uint32_t head;
+    while (tail - (head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) > r->mask) {
+        ring_wait(r, &r->head, head);
+    }
+    r->slots[tail & r->mask] = item;
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_SEQ_CST);
+    ring_wake(r, &r->tail);
+}
+
+void *ring_pop(struct ring *r)
+{
+    uint32_t head = r->head; // Only the consumer writes it
+    uint32_t tail;
+    while ((tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) == head) {
+        ring_wait(r, &r->tail, tail);
+    }
+    void *item = r->slots[head & r->mask];
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_SEQ_CST);
+    ring_wake(r, &r->head);
+    return item;
+}
+
+void ring_free(struct ring *r)
+{
+    free(r->slots);
+    r->slots = NULL;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file ring.h
+ * @brief Bounded lock-free single-producer/single-consumer ring of pointers.
+ *
+ * One thread pushes and one thread pops; neither takes a lock. The head and
+ * tail sit on separate cache lines so the two sides do not contend. A side
+ * that has to wait spins briefly, then sleeps on a futex until the other side
+ * moves, so idle pipeline stages do not burn a core.
+ */
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+
+#define RING_CACHE_LINE 64
+#define RING_SPIN 256 // Polls before a waiting side sleeps
+
+struct ring {
+    uint32_t head __attribute__((aligned(RING_CACHE_LINE))); // Next slot to pop (consumer)
+    uint32_t tail __attribute__((aligned(RING_CACHE_LINE))); // Next slot to push (producer)
+    int sleeping __attribute__((aligned(RING_CACHE_LINE)));  // A side is (about to be) asleep
+    uint32_t mask;
+    void **slots;
+};
+
+/**
+ * @brief Prepares an empty ring.
+ *
+ * @param r The ring.
+ * @param capacity The most items it holds (rounded up to a power of two).
+ * @return 0 on success, -1 if out of memory.
+ */
+int ring_init(struct ring *r, uint32_t capacity);
+
+/**
+ * @brief Adds an item, waiting while the ring is full. Producer only.
+ */
+void ring_push(struct ring *r, void *item);
+
+/**
+ * @brief Removes the oldest item, waiting while the ring is empty. Consumer only.
+ */
+void *ring_pop(struct ring *r);
+
+/**
+ * @brief Releases the ring's slots.
+ */
+void ring_free(struct ring *r);
+
+#endif // RING_H
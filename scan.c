@@ -0,0 +1,155 @@
+/**
+ * @file scan.c
+ * @brief Implementation of the single-input search loop.
+ */
+
+#include "scan.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "memscan.h"
+#include "parallel.h"
+
+/**
+ * @brief Pushes out the results so far before the reader waits for input,
+ * so a live stream's matches are not held back until the buffer fills.
+ */
+static void scan_wait(void *arg)
+{
+    output_flush(arg);
+}
+
+int scan_lines(struct search_ctx *ctx, struct reader *reader, uint64_t *linecount,
+               uint64_t byte_end, int follow, uint64_t *resume)
+{
+    const char *linebuff;
+    size_t linelen;
+    int readstatus = 0;
+    uint64_t nextline;
+
+    *resume = UINT64_MAX;
+    reader->wait = scan_wait;
+    reader->wait_arg = ctx->out;
+    while ((nextline = search_next_in_range(ctx, *linecount)) != 0) {
+
+        // 1. Skip the gap before the next range
+        if (nextline > *linecount) {
+            uint64_t skipped;
+            readstatus = reader_skip_lines(reader, nextline - *linecount, &skipped);
+            *linecount += skipped;
+            if (readstatus < 0 || *linecount < nextline) {
+                break; // Input ended inside the gap
+            }
+        }
+
+        if ((readstatus = reader_next_line(reader, &linebuff, &linelen)) <= 0) {
+            break;
+        }
+
+        // 2. Stop at the first line that begins past the byte range; when following,
+        // an unfinished last line is left to be read again once it is complete
+        if (reader->line_offset >= byte_end) {
+            break;
+        }
+        if (follow && linebuff[linelen - 1] != '\n') {
+            *resume = reader->line_offset;
+            break;
+        }
+        ctx->line_offset = reader->line_offset;
+
+        // 3. Search for all matches in the current line and print them
+        search_emit_line(ctx, *linecount, linebuff, linelen, reader->line_stable);
+        if (ctx->done) {
+            break;
+        }
+
+        (*linecount)++;
+    }
+
+    reader->wait = NULL;
+    if (*resume == UINT64_MAX) {
+        *resume = reader->block_base + reader->pos;
+    }
+    return readstatus < 0 ? -1 : 0;
+}
+
+int scan_indexed(struct search_ctx *ctx, const char *data, size_t len, const struct trigram_index *idx,
+                 const uint64_t *candidates)
+{
+    for (size_t k = 0; k < idx->block_count && !ctx->done; k++) {
+        if (!(candidates[k / 64] & (1ULL << (k % 64)))) {
+            continue;
+        }
+        uint64_t start, end, lines_before;
+        trigram_index_block(idx, k, &start, &end, &lines_before);
+        if (start > end || end > len) {
+            return -1;
+        }
+
+        // Lines are numbered from the block's count, so ranges apply as in a full scan.
+        uint64_t linecount = lines_before + 1;
+        if (search_past_range(ctx, linecount)) {
+            break;
+        }
+        for (uint64_t off = start; off < end && !ctx->done; linecount++) {
+            const char *line = data + off;
+            const char *nl = memchr(line, '\n', (size_t)(end - off));
+            size_t line_len = nl != NULL ? (size_t)(nl - line) + 1 : (size_t)(end - off);
+            if (search_in_range(ctx, linecount)) {
+                search_emit_line(ctx, linecount, line, line_len, 1);
+            }
+            off += line_len;
+        }
+    }
+    return 0;
+}
+
+int scan_file(struct search_ctx *ctx, int fd, const char *path, const char *name, int binary_mode,
+              unsigned threads)
+{
+    struct reader reader;
+    if (reader_open_fd(&reader, fd, path) < 0) {
+        fprintf(stderr, "search: %s: %s\n", name, reader_strerror(errno));
+        return -1;
+    }
+    return scan_reader(ctx, &reader, name, binary_mode, threads);
+}
+
+int scan_reader(struct search_ctx *ctx, struct reader *r, const char *name, int binary_mode,
+                unsigned threads)
+{
+    struct reader reader = *r;
+
+    ctx->name = name;
+    ctx->done = 0;
+    ctx->binary = 0;
+    if (binary_mode != BINARY_TEXT) {
+        const char *head;
+        size_t headlen;
+        ctx->binary = reader_peek(&reader, &head, &headlen) == 0 && memscan_has_nul(head, headlen);
+    }
+
+    int rc = 0;
+    if (ctx->binary && binary_mode == BINARY_SKIP) {
+        // Nothing to search.
+    } else if (reader.frames != NULL) {
+        rc = parallel_search_frames(ctx, reader.format, reader.frames, reader.frame_count, 0,
+                                    threads);
+    } else {
+        uint64_t linecount = 1;
+        uint64_t resume;
+        rc = scan_lines(ctx, &reader, &linecount, UINT64_MAX, 0, &resume);
+    }
+    if (rc < 0) {
+        fprintf(stderr, "search: %s: Error while reading.\n", name);
+    }
+
+    // Results may still reference the mapping
+    if (output_flush(ctx->out) < 0) {
+        rc = -1;
+    }
+    reader_close(&reader);
+    return rc;
+}
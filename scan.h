@@ -0,0 +1,71 @@
+/**
+ * @file scan.h
+ * @brief Searching the lines of one opened input.
+ */
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+
+#include "reader.h"
+#include "search.h"
+#include "trigram.h"
+
+/**
+ * @brief Prints the matches in the lines a reader returns, skipping the gaps
+ * between ranges in bulk and stopping after the last range.
+ *
+ * @param ctx The search context.
+ * @param reader The reader, positioned at the start of a line.
+ * @param linecount The number of that line; receives the number of the next line.
+ * @param byte_end Stop at the first line that begins at or past this offset.
+ * @param follow Stop before an unfinished last line, which --follow reads again once complete.
+ * @param resume Receives the input offset where reading stopped.
+ * @return 0 on success, -1 on a read error.
+ */
+int scan_lines(struct search_ctx *ctx, struct reader *reader, uint64_t *linecount,
+               uint64_t byte_end, int follow, uint64_t *resume);
+
+/**
+ * @brief Prints the matches in the candidate blocks of a trigram index,
+ * skipping the blocks outside the ranges and stopping after the last range.
+ *
+ * @param ctx The search context.
+ * @param data The indexed file's contents.
+ * @param len The file length.
+ * @param idx The file's trigram index.
+ * @param candidates The blocks to search (see trigram_index_candidates).
+ * @return 0 on success, -1 if the index does not fit the file.
+ */
+int scan_indexed(struct search_ctx *ctx, const char *data, size_t len, const struct trigram_index *idx,
+                 const uint64_t *candidates);
+
+/**
+ * @brief Searches a whole file from its first line: the binary check, then
+ * plain, compressed or framed input. Used when several files are searched.
+ *
+ * @param ctx The search context; ctx->name is set to name.
+ * @param fd The open file; it is closed.
+ * @param path The path it was opened under (for sidecar indexes and messages).
+ * @param name The name to print with its results.
+ * @param binary_mode What to do with binary input (enum binary_mode).
+ * @param threads Worker threads for framed input.
+ * @return 0 on success, -1 if the file could not be read.
+ */
+int scan_file(struct search_ctx *ctx, int fd, const char *path, const char *name, int binary_mode,
+              unsigned threads);
+
+/**
+ * @brief Like scan_file, for an input that is already open.
+ *
+ * @param ctx The search context; ctx->name is set to name.
+ * @param reader The open reader, not yet read from; it is closed.
+ * @param name The name to print with its results.
+ * @param binary_mode What to do with binary input (enum binary_mode).
+ * @param threads Worker threads for framed input.
+ * @return 0 on success, -1 if the file could not be read.
+ */
+int scan_reader(struct search_ctx *ctx, struct reader *reader, const char *name, int binary_mode,
+                unsigned threads);
+
+#endif // SCAN_H
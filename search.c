@@ -0,0 +1,275 @@
+/**
+ * @file search.c
+ * @brief Implementation of line matching and result emission.
+ */
+
+#include "search.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int is_word_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+char *search_line(const char *line, size_t line_len, const char *term, uint8_t options)
+{
+    size_t term_len = strlen(term);
+    const char *line_end = line + line_len;
+    const char *current_line_ptr = line;
+    const char *match_ptr = NULL;
+
+    if (term_len == 0 || term_len > line_len) {
+        return NULL;
+    }
+
+    // The inner search loop (only positions where the whole term still fits)
+    while (current_line_ptr + term_len <= line_end) {
+        int match = 1;
+
+        // 1. Check if the first character matches (with optional case-insensitivity)
+        if (!((options & OPTION_IGNORE) ? (toupper(*current_line_ptr) == toupper(*term)) : (*current_line_ptr == *term))) {
+            current_line_ptr++;
+            continue;
+        }
+
+        // 2. Check if the remaining characters match
+        for (size_t i = 1; i < term_len; i++) {
+            if (!((options & OPTION_IGNORE) ? (toupper(current_line_ptr[i]) == toupper(term[i])) : (current_line_ptr[i] == term[i]))) {
+                match = 0;
+                break;
+            }
+        }
+
+        if (match) {
+            // 3. Match found. Now check for isolation if required.
+            if (options & OPTION_ISOLATE) {
+
+                // Check character immediately before the match (if it exists)
+                int start_ok = (current_line_ptr == line) || !is_word_char(*(current_line_ptr - 1));
+
+                // Check character immediately after the match (if it exists)
+                int end_ok = (current_line_ptr + term_len == line_end || !is_word_char(current_line_ptr[term_len]));
+
+                if (start_ok && end_ok) {
+                    match_ptr = current_line_ptr;
+                    // We found an isolated match, return the pointer
+                    return (char *)match_ptr;
+                }
+            } else {
+                // Not isolated search, any match is fine
+                match_ptr = current_line_ptr;
+                return (char *)match_ptr;
+            }
+        }
+
+        // Move to the next character to start the next comparison
+        current_line_ptr++;
+    }
+
+    return NULL; // No match found in the entire line
+}
+
+/**
+ * @brief Finds the first range whose upper bound is at or after a line (binary search).
+ * @return Its index, or range_count if every range ends before the line.
+ */
+static size_t search_find_range(const struct search_ctx *ctx, uint64_t linecount)
+{
+    size_t lo = 0, hi = ctx->range_count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ctx->ranges[mid].high < linecount) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int search_in_range(const struct search_ctx *ctx, uint64_t linecount)
+{
+    if (!(ctx->options & OPTION_RANGE)) {
+        return 1;
+    }
+    size_t i = search_find_range(ctx, linecount);
+    return i < ctx->range_count && linecount >= ctx->ranges[i].low;
+}
+
+int search_past_range(const struct search_ctx *ctx, uint64_t linecount)
+{
+    return (ctx->options & OPTION_RANGE) &&
+           (ctx->range_count == 0 || linecount > ctx->ranges[ctx->range_count - 1].high);
+}
+
+uint64_t search_next_in_range(const struct search_ctx *ctx, uint64_t linecount)
+{
+    if (!(ctx->options & OPTION_RANGE)) {
+        return linecount;
+    }
+    size_t i = search_find_range(ctx, linecount);
+    if (i == ctx->range_count) {
+        return 0;
+    }
+    return linecount >= ctx->ranges[i].low ? linecount : ctx->ranges[i].low;
+}
+
+// "LINE n, POS p, BYTE b: " with the widest numbers
+#define SEARCH_PREFIX_MAX (5 + OUTPUT_U64_MAX_DIGITS + 6 + OUTPUT_U64_MAX_DIGITS + 7 + OUTPUT_U64_MAX_DIGITS + 2)
+
+void search_emit_match(struct search_ctx *ctx, uint64_t linecount, size_t position,
+                       const char *line, size_t len, int stable)
+{
+    // Nothing more can be written once the output has failed.
+    if (ctx->out->error) {
+        ctx->done = 1;
+        return;
+    }
+
+    // Binary input is answered with a single summary line at its first hit.
+    if (ctx->binary) {
+        if (!ctx->done) {
+            char summary[4096];
+            int summarylen = snprintf(summary, sizeof(summary), "Binary file %s matches\n", ctx->name);
+            if (summarylen >= (int)sizeof(summary)) {
+                summarylen = (int)sizeof(summary) - 1;
+            }
+            output_write(ctx->out, summary, (size_t)summarylen, 0);
+            ctx->results++;
+            ctx->done = 1;
+        }
+        return;
+    }
+
+    // Name the input when results from several are mixed
+    if (ctx->show_name) {
+        output_write(ctx->out, ctx->name, strlen(ctx->name), 0);
+        output_write(ctx->out, ": ", 2, 0);
+    }
+
+    // Print the prefix (Line number/Position, byte offset of the line) if required
+    if (ctx->options & (OPTION_LINES | OPTION_BYTES)) {
+        char *prefix = output_reserve(ctx->out, SEARCH_PREFIX_MAX);
+        if (prefix == NULL) {
+            return;
+        }
+        char *p = prefix;
+
+        // Formatted by hand: this runs once per result
+        if (ctx->options & OPTION_LINES) {
+            memcpy(p, "LINE ", 5);
+            p += 5;
+            p += output_format_u64(p, linecount);
+            memcpy(p, ", POS ", 6);
+            p += 6;
+            p += output_format_u64(p, position);
+        }
+        if (ctx->options & OPTION_BYTES) {
+            if (ctx->options & OPTION_LINES) {
+                memcpy(p, ", ", 2);
+                p += 2;
+            }
+            memcpy(p, "BYTE ", 5);
+            p += 5;
+            p += output_format_u64(p, ctx->line_offset);
+        }
+        memcpy(p, ": ", 2);
+        p += 2;
+        if (output_commit(ctx->out, (size_t)(p - prefix)) < 0) {
+            return;
+        }
+    }
+
+    // Print the line content (spliced straight from a mapped input when possible)
+    output_write(ctx->out, line, len, stable);
+    ctx->results++;
+    if (ctx->out->interactive) {
+        output_flush(ctx->out);
+    }
+}
+
+void search_emit_line(struct search_ctx *ctx, uint64_t linecount, const char *line, size_t len, int stable)
+{
+    const char *search_start = line;
+
+    // Loop while matches are found, starting the next search after the last match
+    while ((search_start = search_line(search_start, len - (size_t)(search_start - line),
+                                       ctx->term, ctx->options)) != NULL) {
+
+        // Calculate position based on the start of the line
+        size_t position = (size_t)(search_start - line) + 1;
+        search_emit_match(ctx, linecount, position, line, len, stable);
+
+        // Handle OPTION_REMOVE: if we show the line once, break the inner search loop
+        if ((ctx->options & OPTION_REMOVE) || ctx->done) {
+            break;
+        }
+
+        // Move search_start past the found term to look for the next match on the same line
+        search_start += ctx->term_len;
+    }
+}
+
+/**
+ * @brief Appends a match to a list, growing it as needed.
+ */
+static int match_list_push(struct match_list *matches, const struct match *m)
+{
+    if (matches->count == matches->cap) {
+        size_t cap = matches->cap ? matches->cap * 2 : 64;
+        struct match *grown = realloc(matches->items, cap * sizeof(*grown));
+        if (grown == NULL) {
+            return -1;
+        }
+        matches->items = grown;
+        matches->cap = cap;
+    }
+    matches->items[matches->count++] = *m;
+    return 0;
+}
+
+size_t search_span(const struct search_ctx *ctx, const char *data, size_t len, struct match_list *matches)
+{
+    size_t index = 0;
+    size_t off = 0;
+
+    while (off < len) {
+        const char *line = data + off;
+        const char *nl = memchr(line, '\n', len - off);
+        size_t line_len = nl ? (size_t)(nl - line) + 1 : len - off;
+        const char *search_start = line;
+
+        while ((search_start = search_line(search_start, line_len - (size_t)(search_start - line),
+                                           ctx->term, ctx->options)) != NULL) {
+            struct match m = {
+                .line_off = off,
+                .line_len = line_len,
+                .line_index = index,
+                .position = (size_t)(search_start - line) + 1,
+            };
+            if (match_list_push(matches, &m) < 0) {
+                return (size_t)-1;
+            }
+            if (ctx->options & OPTION_REMOVE) {
+                break;
+            }
+            search_start += ctx->term_len;
+        }
+
+        off += line_len;
+        index++;
+    }
+
+    return index;
+}
+
+void match_list_free(struct match_list *matches)
+{
+    free(matches->items);
+    matches->items = NULL;
+    matches->count = matches->cap = 0;
+}
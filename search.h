@@ -0,0 +1,147 @@
+/**
+ * @file search.h
+ * @brief Line matching and result emission shared by the serial and parallel scanners.
+ */
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "output.h"
+#include "range.h"
+
+// Option bitmasks
+#define OPTION_IGNORE 	(1 << 0) // 0b00000001
+#define OPTION_ISOLATE 	(1 << 1) // 0b00000010
+#define OPTION_LINES	(1 << 2) // 0b00000100
+#define OPTION_RANGE	(1 << 3) // 0b00001000
+#define OPTION_REMOVE	(1 << 4) // 0b00010000
+#define OPTION_SAVE	    (1 << 5) // 0b00100000
+#define OPTION_BYTES	(1 << 6) // 0b01000000
+#define OPTION_FOLLOW	(1 << 7) // 0b10000000
+
+/**
+ * @brief What to do with inputs whose first block contains NUL bytes.
+ */
+enum binary_mode {
+    BINARY_SKIP = 0,            // Do not search them (default)
+    BINARY_MATCHES,             // Print one "Binary file ... matches" line at the first hit
+    BINARY_TEXT                 // Search them like any other input
+};
+
+/**
+ * @brief Everything needed to match lines and print results for one run.
+ */
+struct search_ctx {
+    const char *term;           // The search term
+    size_t term_len;
+    uint8_t options;            // The option field flags
+    const struct line_range *ranges; // Sorted, disjoint line ranges (only with OPTION_RANGE)
+    size_t range_count;
+    struct output *out;         // Result destination
+    uint64_t results;           // Results written so far
+    uint64_t line_offset;       // Input offset of the line being emitted (only with OPTION_BYTES)
+    const char *name;           // Input name for messages
+    int show_name;              // Start every result with the input name (several inputs)
+    int binary;                 // Input is binary: report the first hit only
+    int done;                   // Nothing more will be printed; scanning may stop
+};
+
+/**
+ * @brief A match found by a worker, recorded for in-order printing later.
+ *
+ * Offsets are relative to the span that was scanned, and the line index is
+ * relative to the first line of that span.
+ */
+struct match {
+    size_t line_off;            // Offset of the line within the span
+    size_t line_len;            // Length of the line including its newline
+    size_t line_index;          // 0-based line within the span
+    size_t position;            // 1-based position of the match within the line
+};
+
+struct match_list {
+    struct match *items;
+    size_t count;
+    size_t cap;
+};
+
+/**
+ * @brief Checks if a character is a non-word boundary character (part of a word).
+ * @param c The character to check.
+ * @return 1 if c is a letter, digit, or underscore, 0 otherwise.
+ */
+int is_word_char(char c);
+
+/**
+ * @brief Searches for a term within a line, respecting case-sensitivity and isolation.
+ *
+ * Lines are length-delimited rather than NUL-terminated, so they can be
+ * searched in place inside a mapped file or a read block.
+ *
+ * @param line The line buffer to search.
+ * @param line_len The number of bytes in the line.
+ * @param term The search term.
+ * @param options The option field flags.
+ * @return A pointer to the start of the match in the line, or NULL if no match is found.
+ */
+char *search_line(const char *line, size_t line_len, const char *term, uint8_t options);
+
+/**
+ * @brief Checks whether a line number passes the --range filter.
+ */
+int search_in_range(const struct search_ctx *ctx, uint64_t linecount);
+
+/**
+ * @brief Checks whether a line number lies beyond the end of the last --range,
+ * so that no later line can be printed and reading can stop.
+ */
+int search_past_range(const struct search_ctx *ctx, uint64_t linecount);
+
+/**
+ * @brief Finds the first line at or after linecount that passes the --range filter.
+ *
+ * Lets the scanner skip straight over the gaps between ranges.
+ *
+ * @return That line number, or 0 if no later line is in range.
+ */
+uint64_t search_next_in_range(const struct search_ctx *ctx, uint64_t linecount);
+
+/**
+ * @brief Searches one line and prints every match (or the first, with -R).
+ *
+ * @param ctx The search context.
+ * @param linecount The 1-based line number, used for the -l prefix.
+ * @param line The line, including its newline.
+ * @param len The line length.
+ * @param stable Non-zero if the line stays valid until the output is flushed.
+ */
+void search_emit_line(struct search_ctx *ctx, uint64_t linecount, const char *line, size_t len, int stable);
+
+/**
+ * @brief Prints a single match that has already been located.
+ */
+void search_emit_match(struct search_ctx *ctx, uint64_t linecount, size_t position,
+                       const char *line, size_t len, int stable);
+
+/**
+ * @brief Searches a span of whole lines and records the matches.
+ *
+ * Used by parallel workers, which cannot print directly because output must
+ * stay in file order and their absolute line numbers are not yet known.
+ *
+ * @param ctx The search context (only read).
+ * @param data The span; every line in it ends with a newline.
+ * @param len The span length.
+ * @param matches Receives the matches (appended).
+ * @return The number of lines in the span, or (size_t)-1 if out of memory.
+ */
+size_t search_span(const struct search_ctx *ctx, const char *data, size_t len, struct match_list *matches);
+
+/**
+ * @brief Releases the memory of a match list.
+ */
+void match_list_free(struct match_list *matches);
+
+#endif // SEARCH_H
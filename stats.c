@@ -0,0 +1,103 @@
+/**
+ * @file stats.c
+ * @brief Implementation of the run statistics.
+ */
+
+#include "stats.h"
+
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "hugepage.h"
+#include "numa.h"
+
+/**
+ * @brief Opens a user-space counter for this process and the threads it starts.
+ * @return The counter descriptor, or -1 if unavailable.
+ */
+static int stats_open_counter(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void stats_start(struct stats *stats)
+{
+    clock_gettime(CLOCK_MONOTONIC, &stats->start);
+    stats->workers = NULL;
+    stats->worker_count = 0;
+    stats->workers_ns = 0;
+    stats->dtlb_fd = stats_open_counter(PERF_TYPE_HW_CACHE,
+                                        PERF_COUNT_HW_CACHE_DTLB |
+                                        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+}
+
+uint64_t stats_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void stats_report(struct stats *stats, FILE *stream)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (double)(now.tv_sec - stats->start.tv_sec) +
+                     (double)(now.tv_nsec - stats->start.tv_nsec) / 1e9;
+
+    struct hugepage_usage usage;
+    hugepage_usage(&usage);
+
+    fprintf(stream, "\nStatistics:\n");
+    fprintf(stream, "\tElapsed: %.3f s\n", elapsed);
+    fprintf(stream, "\tScan buffers: %u on huge pages, %u on transparent huge pages, %u on regular pages\n",
+            usage.hugetlb, usage.transparent, usage.regular);
+
+    // Utilization is busy time over the time the pool ran.
+    for (unsigned i = 0; i < stats->worker_count; i++) {
+        const struct worker_stats *w = &stats->workers[i];
+        double busy = stats->workers_ns ? 100.0 * (double)w->busy_ns / (double)stats->workers_ns : 0.0;
+        fprintf(stream, "\tWorker %u: %.1f%% busy, %llu tasks, %llu stolen\n", i + 1, busy,
+                (unsigned long long)w->tasks, (unsigned long long)w->steals);
+    }
+    free(stats->workers);
+    stats->workers = NULL;
+
+    // Throughput per node is bytes over the time its workers spent scanning them.
+    for (unsigned n = 0; n < numa_node_count(); n++) {
+        struct numa_usage node;
+        numa_usage(n, &node);
+        if (node.bytes == 0) {
+            continue;
+        }
+        double mib = (double)node.bytes / (1 << 20);
+        double busy = (double)node.busy_ns / 1e9;
+        fprintf(stream, "\tNode %u: %.1f MiB scanned in %.3f s busy (%.1f MiB/s)\n", numa_node_id(n), mib,
+                busy, busy > 0 ? mib / busy : 0.0);
+    }
+
+    uint64_t misses;
+    if (stats->dtlb_fd >= 0 && read(stats->dtlb_fd, &misses, sizeof(misses)) == sizeof(misses)) {
+        fprintf(stream, "\tdTLB load misses: %llu\n", (unsigned long long)misses);
+    } else {
+        fprintf(stream, "\tdTLB load misses: not available\n");
+    }
+    if (stats->dtlb_fd >= 0) {
+        close(stats->dtlb_fd);
+        stats->dtlb_fd = -1;
+    }
+}
@@ -0,0 +1,50 @@
+/**
+ * @file stats.h
+ * @brief Run statistics printed with --stats.
+ *
+ * Hardware counters are read with perf_event_open(2) and cover every thread
+ * the search starts. Where the kernel or the machine does not provide them
+ * (no PMU, perf_event_paranoid too strict) they are reported as unavailable.
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * @brief What one worker of the file pool did.
+ */
+struct worker_stats {
+    uint64_t busy_ns;           // Time spent running tasks
+    uint64_t tasks;             // Tasks run
+    uint64_t steals;            // Tasks taken from another worker's deque
+};
+
+struct stats {
+    struct timespec start;      // Wall clock at stats_start
+    int dtlb_fd;                // dTLB load-miss counter, or -1
+    struct worker_stats *workers; // Filled in by the file pool (malloc'd), or NULL
+    unsigned worker_count;
+    uint64_t workers_ns;        // Wall time the workers ran for
+};
+
+/**
+ * @brief Starts the clock and the counters. Call before any thread is created,
+ * so that the counters are inherited by them.
+ */
+void stats_start(struct stats *stats);
+
+/**
+ * @brief Reads the monotonic clock, for timing workers.
+ * @return Nanoseconds from an arbitrary start.
+ */
+uint64_t stats_now_ns(void);
+
+/**
+ * @brief Prints the statistics and closes the counters.
+ */
+void stats_report(struct stats *stats, FILE *stream);
+
+#endif // STATS_H
@@ -0,0 +1,482 @@
+/**
+ * @file trigram.c
+ * @brief Implementation of the sidecar trigram index.
+ *
+ * Layout (all integers little-endian, every section 8-byte aligned):
+ *   magic "SRCHTIDX", u64 version, u64 file size, i64 mtime seconds,
+ *   i64 mtime nanoseconds, u64 inode, u64 block count, u64 trigram count,
+ *   u64 block size;
+ *   per block: u64 offset of its first line, u64 lines before it;
+ *   per trigram, in ascending order: u32 trigram, u32 number of blocks,
+ *   u64 offset of its postings;
+ *   the postings: a list of u32 block numbers, or a bitmap of one bit per
+ *   block when that is smaller (a trigram found in more than 1/32 of the
+ *   blocks).
+ *
+ * A trigram is its three bytes, folded to lower case, as a 24-bit number.
+ * Trigrams containing a newline are left out, since no match spans lines.
+ */
+
+#include "trigram.h"
+#include "memscan.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define TRIGRAM_HEADER_SIZE 72
+#define TRIGRAM_BLOCK_ENTRY 16
+#define TRIGRAM_DIR_ENTRY 16
+#define TRIGRAM_KEYS (1u << 24)
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static void put_u64(unsigned char *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_u64(const unsigned char *p)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+static unsigned char trigram_fold(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? (unsigned char)(c + 'a' - 'A') : c;
+}
+
+/**
+ * @brief Checks whether a trigram's postings are a bitmap (else a block list).
+ */
+static int trigram_dense(uint64_t blocks, size_t block_count)
+{
+    return blocks * 4 > ((uint64_t)block_count + 63) / 64 * 8;
+}
+
+/**
+ * @brief Returns the size of a trigram's postings, padded to 8 bytes.
+ */
+static uint64_t trigram_postings_size(uint64_t blocks, size_t block_count)
+{
+    if (trigram_dense(blocks, block_count)) {
+        return ((uint64_t)block_count + 63) / 64 * 8;
+    }
+    return (blocks * 4 + 7) & ~(uint64_t)7;
+}
+
+/**
+ * @brief Fills the fixed header for a file's current identity.
+ */
+static void trigram_header(unsigned char *h, const struct stat *st, size_t block_count, size_t trigram_count)
+{
+    memcpy(h, TRIGRAM_INDEX_MAGIC, 8);
+    put_u64(h + 8, TRIGRAM_INDEX_VERSION);
+    put_u64(h + 16, (uint64_t)st->st_size);
+    put_u64(h + 24, (uint64_t)st->st_mtim.tv_sec);
+    put_u64(h + 32, (uint64_t)st->st_mtim.tv_nsec);
+    put_u64(h + 40, (uint64_t)st->st_ino);
+    put_u64(h + 48, (uint64_t)block_count);
+    put_u64(h + 56, (uint64_t)trigram_count);
+    put_u64(h + 64, TRIGRAM_BLOCK_SIZE);
+}
+
+/**
+ * @brief Collects the distinct trigrams of a block.
+ *
+ * @param data The block.
+ * @param len Its length.
+ * @param seen A cleared bitmap of TRIGRAM_KEYS bits; it is cleared again on return.
+ * @param keys Room for len trigrams; receives them.
+ * @return The number of distinct trigrams.
+ */
+static size_t trigram_block_keys(const unsigned char *data, size_t len, uint64_t *seen, uint32_t *keys)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i + 2 < len; i++) {
+        if (data[i] == '\n' || data[i + 1] == '\n' || data[i + 2] == '\n') {
+            continue;
+        }
+        uint32_t key = (uint32_t)trigram_fold(data[i]) << 16 | (uint32_t)trigram_fold(data[i + 1]) << 8 |
+                       trigram_fold(data[i + 2]);
+        if (!(seen[key / 64] & (1ULL << (key % 64)))) {
+            seen[key / 64] |= 1ULL << (key % 64);
+            keys[count++] = key;
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        seen[keys[i] / 64] &= ~(1ULL << (keys[i] % 64));
+    }
+    return count;
+}
+
+/**
+ * @brief Cuts a file into line-aligned blocks.
+ * @return The malloc'd block start offsets, or NULL if out of memory.
+ */
+static uint64_t *trigram_blocks(const char *data, size_t len, size_t *count)
+{
+    size_t cap = len / TRIGRAM_BLOCK_SIZE + 1;
+    uint64_t *starts = malloc(cap * sizeof(*starts));
+    if (starts == NULL) {
+        return NULL;
+    }
+
+    // Each block runs to the end of the line that crosses its nominal size.
+    size_t n = 0;
+    size_t start = 0;
+    while (start < len) {
+        starts[n++] = start;
+        size_t target = start + TRIGRAM_BLOCK_SIZE;
+        if (target >= len) {
+            break;
+        }
+        const char *nl = memchr(data + target - 1, '\n', len - target + 1);
+        start = nl != NULL ? (size_t)(nl - data) + 1 : len;
+    }
+    *count = n;
+    return starts;
+}
+
+/**
+ * @brief Writes the index into a sidecar file sized for it.
+ * @return 0 on success, -1 on failure (errno is set).
+ */
+static int trigram_write(int fd, const struct stat *st, const char *data, size_t len, const uint64_t *starts,
+                         size_t block_count, uint32_t *counts, uint64_t *seen, uint32_t *keys)
+{
+    // Lay out the directory and postings from the per-trigram block counts.
+    size_t trigram_count = 0;
+    uint64_t size = TRIGRAM_HEADER_SIZE + (uint64_t)block_count * TRIGRAM_BLOCK_ENTRY;
+    for (uint32_t key = 0; key < TRIGRAM_KEYS; key++) {
+        if (counts[key] > 0) {
+            trigram_count++;
+            size += TRIGRAM_DIR_ENTRY + trigram_postings_size(counts[key], block_count);
+        }
+    }
+
+    // Space is reserved up front, so a full disk fails here rather than as SIGBUS on the mapping.
+    int err = posix_fallocate(fd, 0, (off_t)size);
+    if (err == EOPNOTSUPP || err == EINVAL) {
+        err = ftruncate(fd, (off_t)size) == 0 ? 0 : errno;
+    }
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    unsigned char *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    uint32_t *filled = calloc(trigram_count ? trigram_count : 1, sizeof(*filled));
+    if (map == MAP_FAILED || filled == NULL) {
+        if (map != MAP_FAILED) {
+            munmap(map, size);
+        }
+        free(filled);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    trigram_header(map, st, block_count, trigram_count);
+    unsigned char *blocks = map + TRIGRAM_HEADER_SIZE;
+    uint64_t lines = 0;
+    for (size_t k = 0; k < block_count; k++) {
+        uint64_t end = k + 1 < block_count ? starts[k + 1] : len;
+        put_u64(blocks + k * TRIGRAM_BLOCK_ENTRY, starts[k]);
+        put_u64(blocks + k * TRIGRAM_BLOCK_ENTRY + 8, lines);
+        lines += memscan_count_newlines(data + starts[k], (size_t)(end - starts[k]));
+    }
+
+    // From here on counts[key] holds the trigram's directory entry.
+    unsigned char *directory = blocks + (uint64_t)block_count * TRIGRAM_BLOCK_ENTRY;
+    uint64_t offset = (uint64_t)(directory - map) + (uint64_t)trigram_count * TRIGRAM_DIR_ENTRY;
+    size_t entry = 0;
+    for (uint32_t key = 0; key < TRIGRAM_KEYS; key++) {
+        if (counts[key] > 0) {
+            unsigned char *e = directory + entry * TRIGRAM_DIR_ENTRY;
+            put_u32(e, key);
+            put_u32(e + 4, counts[key]);
+            put_u64(e + 8, offset);
+            offset += trigram_postings_size(counts[key], block_count);
+            counts[key] = (uint32_t)entry++;
+        }
+    }
+
+    // Second pass: record every block under each of its trigrams.
+    for (size_t k = 0; k < block_count; k++) {
+        uint64_t end = k + 1 < block_count ? starts[k + 1] : len;
+        size_t n = trigram_block_keys((const unsigned char *)data + starts[k], (size_t)(end - starts[k]), seen, keys);
+        for (size_t i = 0; i < n; i++) {
+            uint32_t e = counts[keys[i]];
+            const unsigned char *d = directory + (size_t)e * TRIGRAM_DIR_ENTRY;
+            unsigned char *postings = map + get_u64(d + 8);
+            if (trigram_dense(get_u32(d + 4), block_count)) {
+                postings[k / 8] |= (unsigned char)(1u << (k % 8));
+            } else {
+                put_u32(postings + 4 * (size_t)filled[e]++, (uint32_t)k);
+            }
+        }
+    }
+
+    free(filled);
+    return munmap(map, size);
+}
+
+int trigram_index_build(const char *path, const struct stat *st, const char *data, size_t len)
+{
+    size_t path_len = strlen(path);
+    char *sidecar = malloc(path_len + sizeof(TRIGRAM_INDEX_SUFFIX) + 4);
+    char *tmp = malloc(path_len + sizeof(TRIGRAM_INDEX_SUFFIX) + 4);
+    size_t block_count = 0;
+    uint64_t *starts = trigram_blocks(data, len, &block_count);
+    uint32_t *counts = calloc(TRIGRAM_KEYS, sizeof(*counts));
+    uint64_t *seen = calloc(TRIGRAM_KEYS / 64, sizeof(*seen));
+
+    // A block has at most one trigram per byte.
+    size_t longest = 0;
+    for (size_t k = 0; starts != NULL && k < block_count; k++) {
+        uint64_t end = k + 1 < block_count ? starts[k + 1] : len;
+        if (end - starts[k] > longest) {
+            longest = (size_t)(end - starts[k]);
+        }
+    }
+    uint32_t *keys = malloc((longest ? longest : 1) * sizeof(*keys));
+
+    int rc = -1;
+    if (sidecar == NULL || tmp == NULL || starts == NULL || counts == NULL || seen == NULL || keys == NULL) {
+        errno = ENOMEM;
+        goto out;
+    }
+    memcpy(sidecar, path, path_len);
+    memcpy(sidecar + path_len, TRIGRAM_INDEX_SUFFIX, sizeof(TRIGRAM_INDEX_SUFFIX));
+    memcpy(tmp, sidecar, path_len + sizeof(TRIGRAM_INDEX_SUFFIX) - 1);
+    memcpy(tmp + path_len + sizeof(TRIGRAM_INDEX_SUFFIX) - 1, ".tmp", 5);
+
+    // First pass: in how many blocks each trigram occurs.
+    for (size_t k = 0; k < block_count; k++) {
+        uint64_t end = k + 1 < block_count ? starts[k + 1] : len;
+        size_t n = trigram_block_keys((const unsigned char *)data + starts[k], (size_t)(end - starts[k]), seen, keys);
+        for (size_t i = 0; i < n; i++) {
+            counts[keys[i]]++;
+        }
+    }
+
+    // Written next to the target and renamed, so readers never see a partial index.
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        goto out;
+    }
+    rc = trigram_write(fd, st, data, len, starts, block_count, counts, seen, keys);
+    if (close(fd) != 0) {
+        rc = -1;
+    }
+    if (rc == 0 && rename(tmp, sidecar) != 0) {
+        rc = -1;
+    }
+    if (rc != 0) {
+        int saved = errno;
+        unlink(tmp);
+        errno = saved;
+    }
+
+out:
+    free(keys);
+    free(seen);
+    free(counts);
+    free(starts);
+    free(tmp);
+    free(sidecar);
+    return rc;
+}
+
+int trigram_index_open(const char *path, const struct stat *st, struct trigram_index *idx)
+{
+    memset(idx, 0, sizeof(*idx));
+
+    size_t path_len = strlen(path);
+    char *sidecar = malloc(path_len + sizeof(TRIGRAM_INDEX_SUFFIX));
+    if (sidecar == NULL) {
+        return -1;
+    }
+    memcpy(sidecar, path, path_len);
+    memcpy(sidecar + path_len, TRIGRAM_INDEX_SUFFIX, sizeof(TRIGRAM_INDEX_SUFFIX));
+    int fd = open(sidecar, O_RDONLY | O_CLOEXEC);
+    free(sidecar);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat sst;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &sst) == 0 && sst.st_size >= TRIGRAM_HEADER_SIZE) {
+        map = mmap(NULL, (size_t)sst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    idx->map = map;
+    idx->map_len = (size_t)sst.st_size;
+
+    // Everything but the counts must match the file as it is now, and the tables must fit.
+    unsigned char expect[TRIGRAM_HEADER_SIZE];
+    uint64_t block_count = get_u64(idx->map + 48);
+    uint64_t trigram_count = get_u64(idx->map + 56);
+    trigram_header(expect, st, (size_t)block_count, (size_t)trigram_count);
+    if (memcmp(idx->map, expect, TRIGRAM_HEADER_SIZE) != 0 ||
+        block_count > idx->map_len / TRIGRAM_BLOCK_ENTRY || trigram_count > idx->map_len / TRIGRAM_DIR_ENTRY ||
+        block_count * TRIGRAM_BLOCK_ENTRY + trigram_count * TRIGRAM_DIR_ENTRY > idx->map_len - TRIGRAM_HEADER_SIZE) {
+        trigram_index_close(idx);
+        return -1;
+    }
+    idx->block_count = (size_t)block_count;
+    idx->trigram_count = (size_t)trigram_count;
+    idx->blocks = idx->map + TRIGRAM_HEADER_SIZE;
+    idx->directory = idx->blocks + idx->block_count * TRIGRAM_BLOCK_ENTRY;
+    return 0;
+}
+
+/**
+ * @brief Finds a trigram's directory entry (binary search).
+ * @return The entry, or NULL if the trigram occurs nowhere.
+ */
+static const unsigned char *trigram_lookup(const struct trigram_index *idx, uint32_t key)
+{
+    size_t lo = 0, hi = idx->trigram_count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        uint32_t k = get_u32(idx->directory + mid * TRIGRAM_DIR_ENTRY);
+        if (k < key) {
+            lo = mid + 1;
+        } else if (k > key) {
+            hi = mid;
+        } else {
+            return idx->directory + mid * TRIGRAM_DIR_ENTRY;
+        }
+    }
+    return NULL;
+}
+
+static int trigram_by_blocks(const void *a, const void *b)
+{
+    uint32_t x = get_u32(*(const unsigned char *const *)a + 4);
+    uint32_t y = get_u32(*(const unsigned char *const *)b + 4);
+    return x < y ? -1 : x > y;
+}
+
+uint64_t *trigram_index_candidates(const struct trigram_index *idx, const char *term, size_t term_len,
+                                   size_t *count)
+{
+    size_t words = (idx->block_count + 63) / 64;
+    uint64_t *bits = malloc((words ? words : 1) * sizeof(*bits));
+    uint64_t *scratch = malloc((words ? words : 1) * sizeof(*scratch));
+    const unsigned char **entries = malloc((term_len ? term_len : 1) * sizeof(*entries));
+    if (bits == NULL || scratch == NULL || entries == NULL) {
+        free(bits);
+        free(scratch);
+        free(entries);
+        return NULL;
+    }
+
+    // Start from every block.
+    memset(bits, 0xff, words * sizeof(*bits));
+    if (idx->block_count % 64) {
+        bits[words - 1] = (1ULL << (idx->block_count % 64)) - 1;
+    }
+
+    // The term's trigrams, rarest first so the candidates shrink fastest.
+    const unsigned char *t = (const unsigned char *)term;
+    size_t n = 0;
+    int missing = 0;
+    for (size_t i = 0; i + 2 < term_len && !missing; i++) {
+        if (t[i] == '\n' || t[i + 1] == '\n' || t[i + 2] == '\n') {
+            continue;
+        }
+        uint32_t key = (uint32_t)trigram_fold(t[i]) << 16 | (uint32_t)trigram_fold(t[i + 1]) << 8 |
+                       trigram_fold(t[i + 2]);
+        entries[n] = trigram_lookup(idx, key);
+        missing = entries[n++] == NULL;
+    }
+    if (missing) {
+        memset(bits, 0, words * sizeof(*bits));
+        n = 0;
+    }
+    qsort(entries, n, sizeof(*entries), trigram_by_blocks);
+
+    for (size_t i = 0; i < n; i++) {
+        uint64_t blocks = get_u32(entries[i] + 4);
+        uint64_t offset = get_u64(entries[i] + 8);
+        if (offset > idx->map_len || trigram_postings_size(blocks, idx->block_count) > idx->map_len - offset) {
+            continue; // Corrupt entry: it cannot narrow the search
+        }
+        const unsigned char *postings = idx->map + offset;
+
+        int any = 0;
+        if (trigram_dense(blocks, idx->block_count)) {
+            for (size_t w = 0; w < words; w++) {
+                bits[w] &= get_u64(postings + 8 * w);
+                any |= bits[w] != 0;
+            }
+        } else {
+            memset(scratch, 0, words * sizeof(*scratch));
+            for (uint64_t j = 0; j < blocks; j++) {
+                uint32_t k = get_u32(postings + 4 * j);
+                if (k < idx->block_count && (bits[k / 64] & (1ULL << (k % 64)))) {
+                    scratch[k / 64] |= 1ULL << (k % 64);
+                    any = 1;
+                }
+            }
+            uint64_t *swap = bits;
+            bits = scratch;
+            scratch = swap;
+        }
+        if (!any) {
+            break;
+        }
+    }
+
+    *count = 0;
+    for (size_t w = 0; w < words; w++) {
+        *count += (size_t)__builtin_popcountll(bits[w]);
+    }
+    free(scratch);
+    free(entries);
+    return bits;
+}
+
+void trigram_index_block(const struct trigram_index *idx, size_t block, uint64_t *start, uint64_t *end,
+                         uint64_t *lines_before)
+{
+    const unsigned char *b = idx->blocks + block * TRIGRAM_BLOCK_ENTRY;
+    *start = get_u64(b);
+    *lines_before = get_u64(b + 8);
+    *end = block + 1 < idx->block_count ? get_u64(b + TRIGRAM_BLOCK_ENTRY) : get_u64(idx->map + 16);
+}
+
+void trigram_index_close(struct trigram_index *idx)
+{
+    if (idx->map != NULL) {
+        munmap((void *)idx->map, idx->map_len);
+    }
+    memset(idx, 0, sizeof(*idx));
+}
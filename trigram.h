@@ -0,0 +1,93 @@
+/**
+ * @file trigram.h
+ * @brief Sidecar trigram index (FILE.tidx) for searching static plain files.
+ *
+ * The file is cut into line-aligned blocks of about TRIGRAM_BLOCK_SIZE
+ * bytes, and for every trigram (three consecutive bytes of a line) the index
+ * lists the blocks it occurs in. A search then looks up the term's trigrams,
+ * intersects their block lists and verifies only the blocks that hold all
+ * of them. Trigrams are folded to lower case, so one index serves both
+ * case-sensitive and -i searches: the folded blocks are a superset of the
+ * exact ones, and verification settles the rest.
+ *
+ * The sidecar is laid out to be used in place from an mmap, without
+ * decoding. Like the line index, it records the size, mtime and inode of the
+ * file it was built from and is ignored as soon as any of them differ.
+ */
+#ifndef TRIGRAM_H
+#define TRIGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define TRIGRAM_INDEX_SUFFIX ".tidx"
+#define TRIGRAM_INDEX_MAGIC "SRCHTIDX"
+#define TRIGRAM_INDEX_VERSION 1
+#define TRIGRAM_BLOCK_SIZE (256 * 1024) // Bytes per block (whole lines, so blocks may run longer)
+#define TRIGRAM_MIN_TERM 3              // Shorter terms have no trigram to look up
+
+/**
+ * @brief A mapped sidecar.
+ */
+struct trigram_index {
+    const unsigned char *map;
+    size_t map_len;
+    size_t block_count;
+    size_t trigram_count;
+    const unsigned char *blocks;    // block_count entries: u64 start offset, u64 lines before
+    const unsigned char *directory; // trigram_count entries: u32 trigram, u32 blocks, u64 postings offset
+};
+
+/**
+ * @brief Builds the sidecar for a plain file and writes it next to the file.
+ *
+ * @param path The indexed file.
+ * @param st The stat of the indexed file.
+ * @param data The file contents.
+ * @param len The file length.
+ * @return 0 on success, -1 on failure (errno is set).
+ */
+int trigram_index_build(const char *path, const struct stat *st, const char *data, size_t len);
+
+/**
+ * @brief Maps the sidecar for a file if it exists and is still valid.
+ *
+ * @param path The indexed file.
+ * @param st The current stat of the indexed file.
+ * @param idx Receives the index.
+ * @return 0 on success, -1 if missing, stale or corrupt.
+ */
+int trigram_index_open(const char *path, const struct stat *st, struct trigram_index *idx);
+
+/**
+ * @brief Finds the blocks that hold every trigram of a term (case folded).
+ *
+ * @param idx The index.
+ * @param term The search term (at least TRIGRAM_MIN_TERM bytes).
+ * @param term_len The term length.
+ * @param count Receives the number of candidate blocks.
+ * @return A malloc'd bitmap of block_count bits (bit k set: block k is a
+ * candidate), or NULL if out of memory.
+ */
+uint64_t *trigram_index_candidates(const struct trigram_index *idx, const char *term, size_t term_len,
+                                   size_t *count);
+
+/**
+ * @brief Returns where a block lies in the indexed file.
+ *
+ * @param idx The index.
+ * @param block The block (0 .. block_count - 1).
+ * @param start Receives the offset of its first line.
+ * @param end Receives the offset just past its last line.
+ * @param lines_before Receives the number of lines before it.
+ */
+void trigram_index_block(const struct trigram_index *idx, size_t block, uint64_t *start, uint64_t *end,
+                         uint64_t *lines_before);
+
+/**
+ * @brief Unmaps the sidecar.
+ */
+void trigram_index_close(struct trigram_index *idx);
+
+#endif // TRIGRAM_H
@@ -0,0 +1,400 @@
+/**
+ * @file walk.c
+ * @brief Implementation of the directory walker.
+ */
+
+#define _GNU_SOURCE
+#include "walk.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @brief An open directory. It stays open while subdirectories queued from
+ * it still need its descriptor for openat(2).
+ */
+struct walk_dir {
+    int fd;
+    char *path;
+    unsigned refs;              // The thread reading it plus every queued child
+};
+
+/**
+ * @brief A subdirectory waiting to be opened and read.
+ */
+struct walk_item {
+    struct walk_dir *parent;
+    char *name;
+    int follow;                 // A root named on the command line: a symlink to it is followed
+};
+
+struct walker {
+    pthread_t *threads;
+    unsigned thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // Signalled when the stack grows or the walk ends
+    pthread_cond_t not_full;    // Signalled when the searcher takes a file
+    pthread_cond_t not_empty;   // Signalled when a file is queued or the walk ends
+
+    // Directories still to read (LIFO, so the tree is walked depth first and
+    // few directories are held open at a time)
+    struct walk_item *stack;
+    size_t stack_len;
+    size_t stack_cap;
+    unsigned active;            // Threads reading a directory right now
+
+    struct walk_file queue[WALK_QUEUE_SIZE];
+    size_t head;                // Counters only grow; slot = counter % WALK_QUEUE_SIZE
+    size_t tail;
+
+    int done;                   // Nothing is left to walk
+    int stop;                   // walk_finish was called early
+    unsigned errors;
+};
+
+/**
+ * @brief Joins a directory path and an entry name.
+ */
+static char *walk_join(const char *dir, const char *name)
+{
+    size_t dirlen = strlen(dir);
+    size_t namelen = strlen(name);
+    int slash = dirlen > 0 && dir[dirlen - 1] != '/';
+    char *path = malloc(dirlen + slash + namelen + 1);
+    if (path != NULL) {
+        memcpy(path, dir, dirlen);
+        if (slash) {
+            path[dirlen] = '/';
+        }
+        memcpy(path + dirlen + slash, name, namelen + 1);
+    }
+    return path;
+}
+
+static void walk_release(struct walk_dir *dir)
+{
+    if (__atomic_sub_fetch(&dir->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        close(dir->fd);
+        free(dir->path);
+        free(dir);
+    }
+}
+
+static void walk_error(struct walker *w, const char *path, int err)
+{
+    fprintf(stderr, "search: %s: %s\n", path, strerror(err));
+    __atomic_add_fetch(&w->errors, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Queues a subdirectory of dir. Called with the lock held.
+ */
+static int walk_push_dir(struct walker *w, struct walk_dir *dir, const char *name)
+{
+    if (w->stack_len == w->stack_cap) {
+        size_t cap = w->stack_cap ? w->stack_cap * 2 : 64;
+        struct walk_item *grown = realloc(w->stack, cap * sizeof(*grown));
+        if (grown == NULL) {
+            return -1;
+        }
+        w->stack = grown;
+        w->stack_cap = cap;
+    }
+    char *copy = strdup(name);
+    if (copy == NULL) {
+        return -1;
+    }
+    __atomic_add_fetch(&dir->refs, 1, __ATOMIC_RELAXED);
+    w->stack[w->stack_len].parent = dir;
+    w->stack[w->stack_len].name = copy;
+    w->stack[w->stack_len].follow = 0;
+    w->stack_len++;
+    pthread_cond_signal(&w->work);
+    return 0;
+}
+
+/**
+ * @brief Hands an opened file to the searcher, waiting while the queue is full.
+ */
+static void walk_push_file(struct walker *w, int fd, char *path)
+{
+    pthread_mutex_lock(&w->lock);
+    while (w->tail - w->head == WALK_QUEUE_SIZE && !w->stop) {
+        pthread_cond_wait(&w->not_full, &w->lock);
+    }
+    if (w->stop) {
+        pthread_mutex_unlock(&w->lock);
+        close(fd);
+        free(path);
+        return;
+    }
+    w->queue[w->tail % WALK_QUEUE_SIZE].fd = fd;
+    w->queue[w->tail % WALK_QUEUE_SIZE].path = path;
+    w->tail++;
+    pthread_cond_signal(&w->not_empty);
+    pthread_mutex_unlock(&w->lock);
+}
+
+/**
+ * @brief Reads every entry of a directory, queueing subdirectories and files.
+ */
+static void walk_read_dir(struct walker *w, struct walk_dir *dir, char *buf)
+{
+    for (;;) {
+        long n = syscall(SYS_getdents64, dir->fd, buf, WALK_DIRENT_BUF);
+        if (n < 0) {
+            walk_error(w, dir->path, errno);
+            return;
+        }
+        if (n == 0) {
+            return;
+        }
+
+        for (long off = 0; off < n;) {
+            // struct linux_dirent64: ino, off, reclen, type, name
+            const char *ent = buf + off;
+            unsigned short reclen;
+            memcpy(&reclen, ent + 16, sizeof(reclen));
+            unsigned char type = (unsigned char)ent[18];
+            const char *name = ent + 19;
+            off += reclen;
+
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            if (type == DT_UNKNOWN) {
+                // Some filesystems do not fill in the type
+                struct stat st;
+                if (fstatat(dir->fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                    continue;
+                }
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_LNK;
+            }
+
+            if (type == DT_DIR) {
+                pthread_mutex_lock(&w->lock);
+                int rc = w->stop ? 0 : walk_push_dir(w, dir, name);
+                pthread_mutex_unlock(&w->lock);
+                if (rc < 0) {
+                    walk_error(w, dir->path, ENOMEM);
+                }
+            } else if (type == DT_REG) {
+                char *path = walk_join(dir->path, name);
+                if (path == NULL) {
+                    walk_error(w, dir->path, ENOMEM);
+                    continue;
+                }
+                int fd = openat(dir->fd, name, O_RDONLY | O_NOCTTY | O_NOFOLLOW | O_CLOEXEC);
+                if (fd < 0) {
+                    walk_error(w, path, errno);
+                    free(path);
+                    continue;
+                }
+                walk_push_file(w, fd, path);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Opens a queued subdirectory relative to its parent.
+ * @return The directory, or NULL if it could not be opened.
+ */
+static struct walk_dir *walk_open(struct walker *w, struct walk_item *item)
+{
+    struct walk_dir *dir = calloc(1, sizeof(*dir));
+    char *path = walk_join(item->parent->path, item->name);
+    int fd = openat(item->parent->fd, item->name,
+                    O_RDONLY | O_DIRECTORY | (item->follow ? 0 : O_NOFOLLOW) | O_CLOEXEC);
+    walk_release(item->parent);
+    free(item->name);
+
+    if (dir == NULL || path == NULL || fd < 0) {
+        walk_error(w, path != NULL ? path : "(directory)", fd < 0 ? errno : ENOMEM);
+        if (fd >= 0) {
+            close(fd);
+        }
+        free(path);
+        free(dir);
+        return NULL;
+    }
+    dir->fd = fd;
+    dir->path = path;
+    dir->refs = 1;
+    return dir;
+}
+
+static void *walk_main(void *arg)
+{
+    struct walker *w = arg;
+    char *buf = malloc(WALK_DIRENT_BUF);
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        // Wait for work while another thread may still push some.
+        while (w->stack_len == 0 && w->active > 0 && !w->stop) {
+            pthread_cond_wait(&w->work, &w->lock);
+        }
+        if (w->stack_len == 0 || w->stop) {
+            break;
+        }
+        struct walk_item item = w->stack[--w->stack_len];
+        w->active++;
+        pthread_mutex_unlock(&w->lock);
+
+        struct walk_dir *dir = walk_open(w, &item);
+        if (dir != NULL) {
+            if (buf != NULL) {
+                walk_read_dir(w, dir, buf);
+            } else {
+                walk_error(w, dir->path, ENOMEM);
+            }
+            walk_release(dir);
+        }
+
+        pthread_mutex_lock(&w->lock);
+        w->active--;
+    }
+
+    // The last thread out ends the walk.
+    if (!w->done && w->stack_len == 0 && w->active == 0) {
+        w->done = 1;
+        pthread_cond_broadcast(&w->work);
+        pthread_cond_broadcast(&w->not_empty);
+    }
+    pthread_mutex_unlock(&w->lock);
+    free(buf);
+    return NULL;
+}
+
+struct walker *walk_start(const char *root, unsigned threads)
+{
+    int fd = open(root, O_RDONLY | O_NOCTTY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+
+    struct walker *w = calloc(1, sizeof(*w));
+    if (w == NULL) {
+        close(fd);
+        return NULL;
+    }
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->work, NULL);
+    pthread_cond_init(&w->not_full, NULL);
+    pthread_cond_init(&w->not_empty, NULL);
+
+    // A file named on the command line is searched as it is.
+    if (!S_ISDIR(st.st_mode)) {
+        w->queue[0].fd = fd;
+        w->queue[0].path = strdup(root);
+        w->tail = 1;
+        w->done = 1;
+        return w;
+    }
+
+    // The root is queued as a child of its own directory entry, so that every
+    // thread starts the same way.
+    struct walk_dir *top = calloc(1, sizeof(*top));
+    char *top_path = strdup(""); // Joined with the root name, giving the root path itself
+    int cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    close(fd);
+    if (top == NULL || top_path == NULL || cwd < 0) {
+        free(top);
+        free(top_path);
+        if (cwd >= 0) {
+            close(cwd);
+        }
+        walk_finish(w);
+        return NULL;
+    }
+    top->fd = cwd;
+    top->path = top_path;
+    top->refs = 1;
+    w->stack = malloc(sizeof(*w->stack));
+    if (w->stack == NULL) {
+        walk_release(top);
+        walk_finish(w);
+        return NULL;
+    }
+    w->stack[0].parent = top;
+    w->stack[0].name = strdup(root);
+    w->stack[0].follow = 1;
+    w->stack_len = 1;
+    w->stack_cap = 1;
+
+    w->threads = calloc(threads ? threads : 1, sizeof(*w->threads));
+    for (unsigned i = 0; w->threads != NULL && i < (threads ? threads : 1); i++) {
+        if (pthread_create(&w->threads[i], NULL, walk_main, w) != 0) {
+            break;
+        }
+        w->thread_count++;
+    }
+    if (w->thread_count == 0) {
+        walk_finish(w);
+        return NULL;
+    }
+    return w;
+}
+
+int walk_next(struct walker *w, struct walk_file *file)
+{
+    pthread_mutex_lock(&w->lock);
+    while (w->head == w->tail && !w->done) {
+        pthread_cond_wait(&w->not_empty, &w->lock);
+    }
+    if (w->head == w->tail) {
+        pthread_mutex_unlock(&w->lock);
+        return 0;
+    }
+    *file = w->queue[w->head % WALK_QUEUE_SIZE];
+    w->head++;
+    pthread_cond_signal(&w->not_full);
+    pthread_mutex_unlock(&w->lock);
+    return 1;
+}
+
+unsigned walk_finish(struct walker *w)
+{
+    pthread_mutex_lock(&w->lock);
+    w->stop = 1;
+    pthread_cond_broadcast(&w->work);
+    pthread_cond_broadcast(&w->not_full);
+    pthread_mutex_unlock(&w->lock);
+    for (unsigned i = 0; i < w->thread_count; i++) {
+        pthread_join(w->threads[i], NULL);
+    }
+
+    // Whatever was found but not searched
+    for (; w->head != w->tail; w->head++) {
+        close(w->queue[w->head % WALK_QUEUE_SIZE].fd);
+        free(w->queue[w->head % WALK_QUEUE_SIZE].path);
+    }
+    for (size_t i = 0; i < w->stack_len; i++) {
+        walk_release(w->stack[i].parent);
+        free(w->stack[i].name);
+    }
+
+    unsigned errors = w->errors;
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->work);
+    pthread_cond_destroy(&w->not_full);
+    pthread_cond_destroy(&w->not_empty);
+    free(w->stack);
+    free(w->threads);
+    free(w);
+    return errors;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file walk.h
+ * @brief Multi-threaded directory walker for --recursive.
+ *
+ * Walker threads share a stack of directories still to be read. Each thread
+ * opens a directory with openat(2) relative to its parent's descriptor,
+ * reads its entries in large getdents64(2) batches and pushes the
+ * subdirectories back onto the stack. Regular files are opened the same way
+ * and handed to the searcher through a bounded queue as soon as they are
+ * found, so searching starts before the walk is over and a full queue holds
+ * the walkers back (which also bounds the open descriptors).
+ *
+ * Symbolic links met during the walk are not followed, and devices, FIFOs
+ * and sockets are skipped, as with grep -r.
+ */
+#ifndef WALK_H
+#define WALK_H
+
+#define WALK_QUEUE_SIZE 256             // Opened files waiting to be searched
+#define WALK_DIRENT_BUF (64 * 1024)     // Bytes of entries per getdents64(2) call
+
+struct walker;
+
+/**
+ * @brief A file found by the walker.
+ */
+struct walk_file {
+    int fd;                     // Open for reading; the caller closes it
+    char *path;                 // The root joined with the names below it (caller frees)
+};
+
+/**
+ * @brief Starts walking a directory tree (or yields a single file).
+ *
+ * @param root The directory (or file) to search.
+ * @param threads The number of walker threads.
+ * @return The walker, or NULL if root could not be opened.
+ */
+struct walker *walk_start(const char *root, unsigned threads);
+
+/**
+ * @brief Takes the next file found, waiting for the walkers if needed.
+ *
+ * @param w The walker.
+ * @param file Receives the file.
+ * @return 1 if a file was returned, 0 once the whole tree has been walked.
+ */
+int walk_next(struct walker *w, struct walk_file *file);
+
+/**
+ * @brief Stops the walk (if still running) and releases the walker.
+ * @return The number of entries that could not be read or opened.
+ */
+unsigned walk_finish(struct walker *w);
+
+#endif // WALK_H